@@ -0,0 +1,122 @@
+#include <stdlib.h>
+
+#include "util.h"
+
+/* counts heap allocations made by common nvif calls, by interposing the
+ * allocator over the whole process.  a round queries the device list,
+ * looks up the device's class list and calls its info method, which must
+ * all be done on the stack, and then does the same on a freshly created
+ * device, where the first lookup allocates the list's cache.  with an
+ * in-process driver (lib, null) the counts include nvkm's side of the
+ * work, use -b shm to see the client alone
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static unsigned long alloc_count;
+static bool alloc_on;
+
+void *
+malloc(size_t size)
+{
+	if (__atomic_load_n(&alloc_on, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	if (__atomic_load_n(&alloc_on, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	if (__atomic_load_n(&alloc_on, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+static int
+alloc_round(struct nvif_client *client, struct nvif_device *device)
+{
+	struct nv_device_info_v0 info = {};
+	const struct nvif_sclass *sclass;
+	int ret;
+
+	if (u_device_name(client, u_dev) == ~0ULL)
+		return -ENODEV;
+	if ((ret = nvif_object_sclass(&device->object, &sclass)) < 0)
+		return ret;
+	return nvif_object_mthd(&device->object, NV_DEVICE_V0_INFO,
+				&info, sizeof(info));
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nvif_client client;
+	struct nvif_device device, temp;
+	unsigned long rounds = 100, count[2], i;
+	bool pass = true;
+	int ret, c;
+
+	while ((c = getopt(argc, argv, U_GETOPT"n:")) != -1) {
+		switch (c) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		default:
+			if (!u_option(c))
+				return 1;
+			break;
+		}
+	}
+
+	ret = u_device("null", argv[0], "error", false, false, 0, 0,
+		       &client, &device);
+	if (ret) {
+		fprintf(stderr, "device init failed, %d\n", ret);
+		return 1;
+	}
+
+	/* the first round fills the device's class list cache */
+	if ((ret = alloc_round(&client, &device))) {
+		fprintf(stderr, "round failed, %d\n", ret);
+		return 1;
+	}
+
+	__atomic_store_n(&alloc_on, true, __ATOMIC_RELAXED);
+	for (i = 0; i < rounds && !ret; i++)
+		ret = alloc_round(&client, &device);
+	count[0] = __atomic_exchange_n(&alloc_count, 0, __ATOMIC_RELAXED);
+
+	for (i = 0; i < rounds && !ret; i++) {
+		ret = nvif_device_init(&client.object, 1, NV_DEVICE,
+				       &(struct nv_device_v0) {
+					.device = u_device_name(&client, u_dev),
+				       }, sizeof(struct nv_device_v0), &temp);
+		if (ret == 0) {
+			ret = alloc_round(&client, &temp);
+			nvif_device_fini(&temp);
+		}
+	}
+	count[1] = __atomic_exchange_n(&alloc_count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&alloc_on, false, __ATOMIC_RELAXED);
+
+	if (ret) {
+		fprintf(stderr, "round failed, %d\n", ret);
+		return 1;
+	}
+
+	printf("%lu rounds: %lu allocations, %lu with device create/destroy\n",
+	       rounds, count[0], count[1]);
+	pass &= count[0] == 0;
+	printf("%s\n", pass ? "ok" : "FAILED");
+
+	nvif_device_fini(&device);
+	nvif_client_fini(&client);
+	return !pass;
+}
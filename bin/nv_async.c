@@ -0,0 +1,238 @@
+#include <nvif/async.h>
+#include <nvif/class.h>
+#include <nvif/ioctl.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* exercises the asynchronous ioctl queue, by default against the null
+ * driver so no hardware is needed.  checks that requests complete in
+ * submission order, that callbacks run and replies are copied back, that
+ * flush waits for everything queued before it, and that submitting to a
+ * full ring blocks until the worker frees a slot.  reports the throughput
+ * of queued versus synchronous requests at the end
+ */
+struct async_nop {
+	struct nvif_async_req req;
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_nop_v0 nop;
+	} args;
+};
+
+static struct {
+	unsigned long seq;
+	unsigned long bad;
+	bool hold;
+	bool held;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} async_cb = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+async_nop_init(struct async_nop *nop, unsigned long i)
+{
+	memset(&nop->args, 0x00, sizeof(nop->args));
+	nop->args.ioctl.type = NVIF_IOCTL_V0_NOP;
+	nop->req.priv = (void *)i;
+}
+
+/* runs on the worker thread, which executes requests one at a time, so
+ * the sequence counter needs no locking of its own
+ */
+static void
+async_nop_done(struct nvif_async_req *req)
+{
+	if (req->ret || (unsigned long)req->priv != async_cb.seq)
+		async_cb.bad++;
+	async_cb.seq++;
+
+	pthread_mutex_lock(&async_cb.mutex);
+	if (async_cb.hold) {
+		async_cb.held = true;
+		pthread_cond_broadcast(&async_cb.cond);
+		while (async_cb.hold)
+			pthread_cond_wait(&async_cb.cond, &async_cb.mutex);
+	}
+	pthread_mutex_unlock(&async_cb.mutex);
+}
+
+static void
+async_hold(bool hold)
+{
+	pthread_mutex_lock(&async_cb.mutex);
+	async_cb.hold = hold;
+	pthread_cond_broadcast(&async_cb.cond);
+	pthread_mutex_unlock(&async_cb.mutex);
+}
+
+static int
+async_submit(struct nvif_async *async, struct async_nop *nop, unsigned long i,
+	     bool cb)
+{
+	async_nop_init(nop, i);
+	nop->req.func = cb ? async_nop_done : NULL;
+	return nvif_async_ioctl(async, &nop->req, &async->client->object,
+				&nop->args, sizeof(nop->args));
+}
+
+struct async_full {
+	struct nvif_async *async;
+	struct async_nop *nop;
+	unsigned long i;
+	bool done;
+};
+
+static void *
+async_full_thread(void *arg)
+{
+	struct async_full *full = arg;
+	async_submit(full->async, full->nop, full->i, true);
+	__atomic_store_n(&full->done, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static bool
+async_check(const char *name, bool pass)
+{
+	printf("%-8s %s\n", name, pass ? "ok" : "FAILED");
+	return pass;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nvif_client client;
+	struct nvif_device device;
+	struct nvif_async async;
+	struct async_nop *nops, wait;
+	struct async_full full;
+	struct nv_client_devlist_v0 list = { .count = 0 }, alist;
+	unsigned long count = 100000, seq, i;
+	u32 depth = 16;
+	pthread_t thread;
+	bool pass = true;
+	u64 time[3];
+	int ret, c;
+
+	while ((c = getopt(argc, argv, U_GETOPT"n:q:")) != -1) {
+		switch (c) {
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		case 'q': depth = strtoul(optarg, NULL, 0); break;
+		default:
+			if (!u_option(c))
+				return 1;
+			break;
+		}
+	}
+
+	if (count < depth + 2 || depth < 2)
+		return 1;
+
+	ret = u_device("null", argv[0], "error", false, false, 0, 0,
+		       &client, &device);
+	if (ret) {
+		fprintf(stderr, "device init failed, %d\n", ret);
+		return 1;
+	}
+
+	if (!(nops = calloc(count, sizeof(*nops))) ||
+	    (ret = nvif_async_init(&client, depth, &async))) {
+		fprintf(stderr, "async init failed, %d\n", ret);
+		return 1;
+	}
+
+	/* callbacks run in submission order while the client thread keeps
+	 * issuing its own requests alongside the worker, and flush must not
+	 * return before the last of them ran
+	 */
+	for (i = 0; i < count; i++) {
+		async_submit(&async, &nops[i], i, true);
+		if (!(i % 64))
+			nvif_object_mthd(&client.object, NV_CLIENT_DEVLIST,
+					 &list, sizeof(list));
+	}
+	nvif_async_flush(&async);
+	pass &= async_check("order", !async_cb.bad);
+	pass &= async_check("flush", async_cb.seq == count);
+
+	/* requests without a callback complete through done/wait, and
+	 * methods copy back the same reply they get synchronously
+	 */
+	alist = (struct nv_client_devlist_v0) { .count = 0 };
+	ret = nvif_async_mthd(&async, &wait.req, &client.object,
+			      NV_CLIENT_DEVLIST, &alist, sizeof(alist));
+	if (ret == 0)
+		ret = nvif_async_wait(&async, &wait.req);
+	pass &= async_check("mthd", ret == 0 && nvif_async_done(&wait.req) &&
+				    alist.count && alist.count == list.count);
+
+	/* with the worker held in a callback, the ring takes exactly depth
+	 * more requests, and one past that must block until it's released
+	 */
+	async_hold(true);
+	seq = async_cb.seq;
+	for (i = 0; i < depth + 1; i++)
+		async_submit(&async, &nops[i], seq + i, true);
+	pthread_mutex_lock(&async_cb.mutex);
+	while (!async_cb.held)
+		pthread_cond_wait(&async_cb.cond, &async_cb.mutex);
+	pthread_mutex_unlock(&async_cb.mutex);
+
+	full = (struct async_full) {
+		.async = &async,
+		.nop = &nops[depth + 1],
+		.i = seq + depth + 1,
+	};
+	pthread_create(&thread, NULL, async_full_thread, &full);
+	usleep(10000);
+	pass &= async_check("full", !__atomic_load_n(&full.done,
+						      __ATOMIC_ACQUIRE));
+	async_hold(false);
+	pthread_join(thread, NULL);
+	nvif_async_flush(&async);
+	pass &= async_check("drain", full.done && !async_cb.bad &&
+				     async_cb.seq == count + depth + 2);
+
+	/* throughput: queued with callbacks, queued and then each waited on,
+	 * and synchronous
+	 */
+	seq = async_cb.seq;
+	time[0] = ktime_get();
+	for (i = 0; i < count; i++)
+		async_submit(&async, &nops[i], seq + i, true);
+	nvif_async_flush(&async);
+	time[0] = ktime_get() - time[0];
+
+	time[1] = ktime_get();
+	for (i = 0; i < count; i++)
+		async_submit(&async, &nops[i], 0, false);
+	for (i = 0; i < count; i++)
+		nvif_async_wait(&async, &nops[i].req);
+	time[1] = ktime_get() - time[1];
+
+	time[2] = ktime_get();
+	for (i = 0; i < count; i++) {
+		async_nop_init(&nops[i], i);
+		nvif_object_ioctl(&client.object, &nops[i].args,
+				  sizeof(nops[i].args), NULL);
+	}
+	time[2] = ktime_get() - time[2];
+
+	printf("%lu nops, depth %u: callback %lluns, wait %lluns, "
+	       "sync %lluns per request\n", count, depth,
+	       (unsigned long long)time[0] / count,
+	       (unsigned long long)time[1] / count,
+	       (unsigned long long)time[2] / count);
+
+	nvif_async_fini(&async);
+	free(nops);
+	nvif_device_fini(&device);
+	nvif_client_fini(&client);
+	return !pass;
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "util.h"
+
+/* measures interrupt delivery latency of the shim's interrupt threads, by
+ * sharing the null device's interrupt line and raising it through the null
+ * driver with null_intr_trigger().  this needs no hardware, and reports a
+ * histogram of the time from injection to the handler running.  with
+ * $NVOS_MMIO_REPLAY set, the device's own nvkm handler is driven as well
+ */
+#define INTR_BUCKETS 24
+
+static struct {
+	u64 trigger;
+	u64 hist[INTR_BUCKETS];
+	u64 min, max, sum;
+} intr = { .min = ~0ULL };
+
+static irqreturn_t
+intr_handler(int irq, void *arg)
+{
+	u64 time = __atomic_load_n(&intr.trigger, __ATOMIC_ACQUIRE), lat;
+	int bucket = 0;
+
+	if (!time)
+		return IRQ_NONE;
+
+	lat = ktime_get() - time;
+	while (bucket < INTR_BUCKETS - 1 && (lat >> (bucket + 1)) >= 1000)
+		bucket++;
+
+	intr.hist[bucket]++;
+	intr.min = min(intr.min, lat);
+	intr.max = max(intr.max, lat);
+	intr.sum += lat;
+	__atomic_store_n(&intr.trigger, 0, __ATOMIC_RELEASE);
+	return IRQ_HANDLED;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nvif_client client;
+	struct nvif_device device;
+	unsigned long count = 10000, delay = 100, done, i;
+	u64 most = 0;
+	bool replay;
+	int ret, line, c;
+
+	while ((c = getopt(argc, argv, U_GETOPT"i:n:")) != -1) {
+		switch (c) {
+		case 'i': delay = strtoul(optarg, NULL, 0); break;
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		default:
+			if (!u_option(c))
+				return 1;
+			break;
+		}
+	}
+
+	if (!count)
+		return 1;
+
+	/* when replaying a trace, the device is detected from it and gets a
+	 * PCI subdev, putting nvkm's own handler on the line as well
+	 */
+	replay = getenv("NVOS_MMIO_REPLAY") != NULL;
+	ret = u_device("null", argv[0], "error", replay, replay,
+		       (1ULL << NVKM_SUBDEV_PCI) | (1ULL << NVKM_SUBDEV_MC), 0,
+		       &client, &device);
+	if (ret) {
+		fprintf(stderr, "device init failed, %d\n", ret);
+		return 1;
+	}
+
+	line = null_intr_line();
+	ret = line < 0 ? line : request_irq(line, intr_handler, IRQF_SHARED,
+					    "nv_intr", &intr);
+	if (ret) {
+		fprintf(stderr, "request_irq failed, %d\n", ret);
+		return 1;
+	}
+
+	for (done = 0; done < count; done++) {
+		__atomic_store_n(&intr.trigger, ktime_get(), __ATOMIC_RELEASE);
+		if ((ret = null_intr_trigger())) {
+			fprintf(stderr, "trigger failed, %d\n", ret);
+			break;
+		}
+		while (__atomic_load_n(&intr.trigger, __ATOMIC_ACQUIRE))
+			usleep(1);
+		if (delay)
+			usleep(delay);
+	}
+
+	free_irq(line, &intr);
+	nvif_device_fini(&device);
+	nvif_client_fini(&client);
+	if (!done)
+		return 1;
+	count = done;
+
+	printf("%lu interrupts, min %lluus avg %lluus max %lluus\n", count,
+	       (unsigned long long)intr.min / 1000,
+	       (unsigned long long)intr.sum / count / 1000,
+	       (unsigned long long)intr.max / 1000);
+
+	for (i = 0; i < INTR_BUCKETS; i++)
+		most = max(most, intr.hist[i]);
+	for (i = 0; i < INTR_BUCKETS; i++) {
+		if (!intr.hist[i])
+			continue;
+		printf("<%7luus %8llu %.*s\n", 1UL << (i + 1),
+		       (unsigned long long)intr.hist[i],
+		       (int)(intr.hist[i] * 50 / most),
+		       "##################################################");
+	}
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+
+#include "util.h"
+
+#include <nvif/ioctl.h>
+
+/* times nop ioctls addressed to objects of a client holding 1, 100 and
+ * then the given number of objects, by default on the null driver.  each
+ * count is measured cycling over a handful of hot objects, and over
+ * objects picked at random, which is where the cost of resolving the
+ * object's handle shows
+ */
+#define LOOKUP_HOT 8
+
+static u64
+lookup_run(struct nvif_object *objects, unsigned long count,
+	   const u32 *index, unsigned long ioctls, bool hot, int *ret)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_nop_v0 nop;
+	} args;
+	unsigned long i;
+	u64 time;
+
+	time = ktime_get();
+	for (i = 0; i < ioctls && !*ret; i++) {
+		struct nvif_object *object;
+
+		if (hot)
+			object = &objects[i % min(count, LOOKUP_HOT)];
+		else
+			object = &objects[index[i] % count];
+
+		args = (typeof(args)) { .ioctl.type = NVIF_IOCTL_V0_NOP };
+		*ret = nvif_object_ioctl(object, &args, sizeof(args), NULL);
+	}
+	time = ktime_get() - time;
+	return time / ioctls;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nvif_client client;
+	struct nvif_device device;
+	struct nvif_object *objects;
+	unsigned long count = 100000, ioctls = 1000000, made = 0, i;
+	unsigned long steps[] = { 1, 100, 0 };
+	u64 name;
+	u32 *index;
+	int ret, c;
+
+	while ((c = getopt(argc, argv, U_GETOPT"i:n:")) != -1) {
+		switch (c) {
+		case 'i': ioctls = strtoul(optarg, NULL, 0); break;
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		default:
+			if (!u_option(c))
+				return 1;
+			break;
+		}
+	}
+
+	if (!count || !ioctls)
+		return 1;
+	steps[ARRAY_SIZE(steps) - 1] = count;
+
+	ret = u_device("null", argv[0], "error", false, false, 0, 0,
+		       &client, &device);
+	if (ret) {
+		fprintf(stderr, "device init failed, %d\n", ret);
+		return 1;
+	}
+
+	name = u_device_name(&client, u_dev);
+	objects = calloc(count, sizeof(*objects));
+	index = calloc(ioctls, sizeof(*index));
+	if (!objects || !index)
+		return 1;
+
+	srand48(count);
+	for (i = 0; i < ioctls; i++)
+		index[i] = lrand48();
+
+	printf("%8s %10s %10s\n", "objects", "hot", "random");
+	for (i = 0; i < ARRAY_SIZE(steps) && !ret; i++) {
+		u64 hot, random;
+
+		if (steps[i] > count || (i && steps[i] == steps[i - 1]))
+			continue;
+
+		while (made < steps[i] && !ret) {
+			ret = nvif_object_init(&client.object, made + 1,
+					       NV_DEVICE,
+					       &(struct nv_device_v0) {
+						.device = name,
+					       }, sizeof(struct nv_device_v0),
+					       &objects[made]);
+			if (ret == 0)
+				made++;
+		}
+
+		hot = lookup_run(objects, made, index, ioctls, true, &ret);
+		random = lookup_run(objects, made, index, ioctls, false, &ret);
+		if (ret == 0) {
+			printf("%8lu %8lluns %8lluns\n", made,
+			       (unsigned long long)hot,
+			       (unsigned long long)random);
+		}
+	}
+
+	if (ret)
+		fprintf(stderr, "failed with %lu objects, %d\n", made, ret);
+
+	while (made)
+		nvif_object_fini(&objects[--made]);
+	free(index);
+	free(objects);
+	nvif_device_fini(&device);
+	nvif_client_fini(&client);
+	return ret != 0;
+}
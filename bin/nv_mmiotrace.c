@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <core/subdev.h>
+
+#include "util.h"
+
+/* dumps a register trace recorded by a MMIOTRACE=y build, one access per
+ * line in time order, or with -p, a summary of the accesses made by each
+ * subdev and the span of time over which it made them
+ */
+static const char *
+trace_name(u8 subdev)
+{
+	if (subdev >= NVKM_SUBDEV_NR || !nvkm_subdev_name[subdev])
+		return "device";
+	return nvkm_subdev_name[subdev];
+}
+
+static void
+trace_dump(const struct os_mmio_rec *rec, u32 nr, const char *subdev,
+	   bool writes)
+{
+	u32 i;
+
+	for (i = 0; i < nr; i++, rec++) {
+		const char *name = trace_name(rec->subdev);
+		bool wr = !!(rec->flags & OS_MMIO_WRITE);
+		int size = rec->flags & OS_MMIO_SIZE;
+
+		if ((subdev && strcmp(subdev, name)) || (writes && !wr))
+			continue;
+
+		printf("%5llu.%06llu %3u %-7s %c%-2d %06x %0*x\n",
+		       (unsigned long long)(rec->time / 1000000000),
+		       (unsigned long long)(rec->time % 1000000000) / 1000,
+		       rec->thread, name, wr ? 'W' : 'R', size * 8,
+		       rec->addr, size * 2, rec->data);
+	}
+}
+
+static void
+trace_profile(const struct os_mmio_rec *rec, u32 nr)
+{
+	struct {
+		u32 rd, wr;
+		u64 first, last;
+	} sum[OS_MMIO_NONE + 1] = {};
+	u32 i;
+
+	for (i = 0; i < nr; i++, rec++) {
+		typeof(*sum) *s = &sum[rec->subdev];
+		if (!s->rd && !s->wr)
+			s->first = rec->time;
+		s->last = rec->time;
+		if (rec->flags & OS_MMIO_WRITE)
+			s->wr++;
+		else
+			s->rd++;
+	}
+
+	printf("%-7s %10s %10s %12s %12s\n",
+	       "subdev", "reads", "writes", "first (us)", "span (us)");
+	for (i = 0; i < ARRAY_SIZE(sum); i++) {
+		if (!sum[i].rd && !sum[i].wr)
+			continue;
+		printf("%-7s %10u %10u %12llu %12llu\n", trace_name(i),
+		       sum[i].rd, sum[i].wr,
+		       (unsigned long long)sum[i].first / 1000,
+		       (unsigned long long)(sum[i].last - sum[i].first) / 1000);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *subdev = NULL;
+	struct os_mmio_head head;
+	struct os_mmio_rec *rec;
+	bool profile = false, writes = false;
+	u32 nr;
+	int ret, c;
+
+	while ((c = getopt(argc, argv, "ps:w")) != -1) {
+		switch (c) {
+		case 'p': profile = true; break;
+		case 's': subdev = optarg; break;
+		case 'w': writes = true; break;
+		default:
+			return 1;
+		}
+	}
+
+	if (argc - optind != 1)
+		return 1;
+
+	if ((ret = os_mmio_load(argv[optind], &head, &rec, &nr))) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(-ret));
+		return 1;
+	}
+
+	printf("# boot0 %08x strap %08x, %u accesses\n",
+	       head.boot0, head.strap, nr);
+	if (profile)
+		trace_profile(rec, nr);
+	else
+		trace_dump(rec, nr, subdev, writes);
+
+	free(rec);
+	return 0;
+}
@@ -36,10 +36,12 @@
 #include <sys/time.h>
 
 #include "util.h"
+#include "sample.h"
 
 static struct nvif_client client;
 static struct nvif_device _device, *device = &_device;
 static struct nvif_object perfmon;
+static struct nvif_batch batch;
 static int nr_signals; /* number of signals for all domains */
 
 #define SEC_US  1000000
@@ -254,6 +256,8 @@ struct ui_perfmon_dom {
 	struct list_head head;
 	struct list_head signals;
 	struct list_head perfdoms;
+	char name[64];
+	u8 counter_nr;
 	u8 id;
 };
 
@@ -276,12 +280,19 @@ struct ui_perfdom {
 	struct list_head head;
 	struct ui_main *ctr[4];
 	u32 handle;
+	u16 index;
+
+	struct nvif_perfdom_read_v0 read;
+	int read_ret;
+	int init_ret;
+	int sample_ret;
 };
 
 static struct list_head ui_main_list = LIST_HEAD_INIT(ui_main_list);
 static struct list_head ui_doms_list = LIST_HEAD_INIT(ui_doms_list);
 static struct list_head ui_perfdom_list = LIST_HEAD_INIT(ui_perfdom_list);
 static u32 ui_main_handle = 0xc0000000;
+static u16 ui_perfdom_nr;
 
 static void
 ui_main_remove(struct ui_main *item)
@@ -340,6 +351,8 @@ ui_perfmon_query_domains(void)
 		if (prev_iter) {
 			dom = calloc(1, sizeof(*dom));
 			dom->id = args.id;
+			dom->counter_nr = args.counter_nr;
+			strncpy(dom->name, args.name, sizeof(dom->name));
 			INIT_LIST_HEAD(&dom->signals);
 			INIT_LIST_HEAD(&dom->perfdoms);
 			list_add_tail(&dom->head, &ui_doms_list);
@@ -355,47 +368,99 @@ ui_perfmon_query_domains(void)
 	} while (args.iter != 0xff);
 }
 
+/* the perfdom methods are queued on the batch, and only complete once the
+ * batch has been executed
+ */
 static void
 ui_perfdom_init(struct ui_perfdom *dom)
 {
-	struct nvif_perfdom_init args = {};
-	int ret;
+	static struct nvif_perfdom_init args;
 
-	ret = nvif_mthd(&dom->object, NVIF_PERFDOM_V0_INIT,
-			&args, sizeof(args));
-	assert(ret == 0);
+	nvif_batch_mthd(&batch, &dom->object, NVIF_PERFDOM_V0_INIT,
+			&args, sizeof(args), &dom->init_ret);
 }
 
 static void
 ui_perfdom_sample(struct ui_perfdom *dom)
 {
-	struct nvif_perfdom_sample args = {};
+	static struct nvif_perfdom_sample args;
+
+	nvif_batch_mthd(&batch, &dom->object, NVIF_PERFDOM_V0_SAMPLE,
+			&args, sizeof(args), &dom->sample_ret);
+}
+
+static struct {
+	struct nvif_perfmon_read_all_v0 *args;
+	u32 size;
 	int ret;
+} ui_read_all;
 
-	ret = nvif_mthd(&dom->object, NVIF_PERFDOM_V0_SAMPLE,
-			&args, sizeof(args));
-	assert(ret == 0);
+/* every perfdom that was counting is read back by the one method, and the
+ * results handed out to each of them once the batch has been executed
+ */
+static void
+ui_perfmon_read(void)
+{
+	struct nvif_perfmon_read_all_v0 *args = ui_read_all.args;
+	u32 size = sizeof(*args) + ui_perfdom_nr * sizeof(args->dom[0]);
+
+	if (size > ui_read_all.size) {
+		args = realloc(args, size);
+		assert(args);
+		ui_read_all.args = args;
+		ui_read_all.size = size;
+	}
+
+	memset(args, 0x00, size);
+	args->count = ui_perfdom_nr;
+	nvif_batch_mthd(&batch, &perfmon, NVIF_PERFMON_V0_READ_ALL,
+			args, size, &ui_read_all.ret);
 }
 
 static void
-ui_perfdom_read(struct ui_perfdom *dom)
+ui_perfmon_read_done(void)
 {
-	struct nvif_perfdom_read_v0 args = {};
-	int ret, i;
+	struct nvif_perfmon_read_all_v0 *args = ui_read_all.args;
+	struct nvif_object *object;
+	struct ui_perfdom *dom;
+	int i;
 
-	ret = nvif_mthd(&dom->object, NVIF_PERFDOM_V0_READ,
-			&args, sizeof(args));
-	assert(ret == 0 || ret == -EAGAIN);
+	assert(ui_read_all.ret == 0);
+	assert(args->count <= ui_perfdom_nr);
 
-	if (ret == 0) {
+	for (i = 0; i < args->count; i++) {
+		if (!args->dom[i].clk)
+			continue;
+
+		object = (void *)(unsigned long)args->dom[i].object;
+		dom = container_of(object, typeof(*dom), object);
+
+		memcpy(dom->read.ctr, args->dom[i].ctr, sizeof(dom->read.ctr));
+		dom->read.clk = args->dom[i].clk;
+		dom->read_ret = 0;
+	}
+}
+
+static void
+ui_perfdom_done(struct ui_perfdom *dom)
+{
+	int i;
+
+	assert(dom->init_ret == 0);
+	assert(dom->sample_ret == 0);
+	assert(dom->read_ret == 0 || dom->read_ret == -EAGAIN);
+
+	if (dom->read_ret == 0) {
 		for (i = 0; i < 4; i++) {
 			if (!dom->ctr[i])
 				continue;
-			dom->ctr[i]->ctr   = args.ctr[i];
-			dom->ctr[i]->incr += args.ctr[i];
-			dom->ctr[i]->clk   = args.clk;
+			dom->ctr[i]->ctr   = dom->read.ctr[i];
+			dom->ctr[i]->incr += dom->read.ctr[i];
+			dom->ctr[i]->clk   = dom->read.clk;
 		}
 	}
+
+	dom->read_ret = -EAGAIN;
 }
 
 static void
@@ -407,6 +472,8 @@ ui_perfmon_init(void)
 			       NVIF_IOCTL_NEW_V0_PERFMON, NULL, 0, &perfmon);
 	assert(ret == 0);
 
+	nvif_batch_init(&batch, &client);
+
 	/* query available domains for the device */
 	ui_perfmon_query_domains();
 }
@@ -447,84 +514,101 @@ ui_perfmon_fini(void)
 		free(dom);
 	}
 
+	free(ui_read_all.args);
+	nvif_batch_fini(&batch);
 	nvif_object_fini(&perfmon);
 }
 
+/* packs a counter into the first of the domain's perfdoms with a free slot,
+ * only creating another perfdom once all the existing ones are full
+ */
+static void
+ui_perfdom_add(struct ui_perfmon_dom *dom, struct ui_main *item)
+{
+	struct ui_perfdom *perfdom;
+	int nr = min(dom->counter_nr, (int)ARRAY_SIZE(perfdom->ctr));
+	int i;
+
+	list_for_each_entry(perfdom, &dom->perfdoms, head) {
+		for (i = 0; i < nr; i++) {
+			if (!perfdom->ctr[i]) {
+				perfdom->ctr[i] = item;
+				return;
+			}
+		}
+	}
+
+	/* no free slots, create a new perfdom */
+	perfdom = calloc(1, sizeof(*perfdom));
+	perfdom->handle = ui_main_handle++;
+	ui_perfdom_nr++;
+	perfdom->read_ret = -EAGAIN;
+	perfdom->ctr[0] = item;
+	list_add_tail(&perfdom->head, &dom->perfdoms);
+}
+
+static void
+ui_perfdom_create(struct ui_perfmon_dom *dom)
+{
+	struct ui_perfdom *perfdom;
+	int ret, i;
+
+	list_for_each_entry(perfdom, &dom->perfdoms, head) {
+		struct nvif_perfdom_v0 args = {};
+
+		args.domain = dom->id;
+		for (i = 0; i < 4; i++) {
+			struct ui_main *ctr = perfdom->ctr[i];
+			if (!ctr)
+				continue;
+			args.ctr[i].signal[0] = ctr->sig->signal;
+			args.ctr[i].logic_op  = 0xaaaa;
+		}
+
+		ret = nvif_object_init(&perfmon, perfdom->handle,
+				       NVIF_IOCTL_NEW_V0_PERFDOM,
+				       &args, sizeof(args),
+				       &perfdom->object);
+		assert(ret == 0);
+	}
+}
+
 static void
 ui_main_select(void)
 {
-	struct ui_main *item, *temp;
+	struct ui_main *item;
 	struct ui_perfmon_dom *dom;
 	struct ui_perfmon_sig *sig;
-	struct ui_perfdom *perfdom;
-	int ret;
-	int i;
 
-	list_for_each_entry_safe(item, temp, &ui_main_list, head) {
-		ui_main_remove(item);
+	while (!list_empty(&ui_main_list)) {
+		ui_main_remove(list_first_entry(&ui_main_list,
+						typeof(*item), head));
 	}
 
 	list_for_each_entry(dom, &ui_doms_list, head) {
 		list_for_each_entry(sig, &dom->signals, head) {
-			bool found = false;
-
 			item = calloc(1, sizeof(*item));
 			item->sig = sig;
 			list_add_tail(&item->head, &ui_main_list);
-
-			/* find a slot */
-			list_for_each_entry(perfdom, &dom->perfdoms, head) {
-				for (i = 0; i < 4; i++) {
-					if (!perfdom->ctr[i]) {
-						perfdom->ctr[i] = item;
-						found = true;
-						break;
-					}
-				}
-			}
-
-			if (!found) {
-				/* no free slots, create a new perfdom */
-				perfdom = calloc(1, sizeof(*perfdom));
-				perfdom->handle = ui_main_handle++;
-				perfdom->ctr[0] = item;
-				list_add_tail(&perfdom->head, &dom->perfdoms);
-			}
+			ui_perfdom_add(dom, item);
 		}
 
 		/* init perfdom objects */
-		list_for_each_entry(perfdom, &dom->perfdoms, head) {
-			struct nvif_perfdom_v0 args = {};
-			int i;
-
-			args.domain = dom->id;
-			for (i = 0; i < 4; i++) {
-				struct ui_main *ctr = perfdom->ctr[i];
-				if (!ctr)
-					continue;
-				args.ctr[i].signal[0] = ctr->sig->signal;
-				args.ctr[i].logic_op  = 0xaaaa;
-			}
-
-			ret = nvif_object_init(&perfmon, perfdom->handle,
-					       NVIF_IOCTL_NEW_V0_PERFDOM,
-					       &args, sizeof(args),
-					       &perfdom->object);
-			assert(ret == 0);
-		}
+		ui_perfdom_create(dom);
 	}
 }
 
-static void
-ui_main_alarm_handler(int signal)
+/* queues a frame's worth of methods on the batch, latching the counters of
+ * the perfdoms started last frame, reading them back, and starting the next
+ * perfdom of each domain counting for the frame after
+ */
+static bool
+ui_perfmon_frame(void)
 {
 	struct ui_perfmon_dom *dom;
 	struct ui_perfdom *perfdom;
 	bool sampled = false;
 
-	if (list_empty(&ui_main_list))
-		ui_main_select();
-
 	list_for_each_entry(dom, &ui_doms_list, head) {
 		if (list_empty(&dom->perfdoms))
 			continue;
@@ -532,21 +616,46 @@ ui_main_alarm_handler(int signal)
 		perfdom = list_first_entry(&dom->perfdoms,
 					   typeof(*perfdom), head);
 
-		/* sample previous batch of counters */
+		/* sample and read previous batch of counters */
 		if (!sampled) {
 			ui_perfdom_sample(perfdom);
+			ui_perfmon_read();
 			sampled = true;
 		}
 
-		/* read previous batch of counters */
-		ui_perfdom_read(perfdom);
-
 		/* setup next batch of counters for sampling */
 		list_move_tail(&perfdom->head, &dom->perfdoms);
 		perfdom = list_first_entry(&dom->perfdoms,
 					   typeof(*perfdom), head);
 		ui_perfdom_init(perfdom);
 	}
+
+	return sampled;
+}
+
+static void
+ui_main_alarm_handler(int signal)
+{
+	struct ui_perfmon_dom *dom;
+	struct ui_perfdom *perfdom;
+	bool sampled;
+	int ret;
+
+	if (list_empty(&ui_main_list))
+		ui_main_select();
+
+	sampled = ui_perfmon_frame();
+
+	/* submit the whole frame's worth of methods at once */
+	ret = nvif_batch_exec(&batch);
+	assert(ret == 0);
+	if (sampled)
+		ui_perfmon_read_done();
+
+	list_for_each_entry(dom, &ui_doms_list, head) {
+		list_for_each_entry(perfdom, &dom->perfdoms, head)
+			ui_perfdom_done(perfdom);
+	}
 }
 
 static struct sigaction
@@ -812,17 +921,216 @@ ui_resize(void)
 	ui_create();
 }
 
+/*******************************************************************************
+ * Headless tracing
+ ******************************************************************************/
+
+/* the trace is a struct trace_head, a struct trace_dom describing each of
+ * the perfdoms the requested signals were packed into, and then a struct
+ * trace_rec each time a perfdom's counters are read back, all in host byte
+ * order.
+ *
+ * domains with more signals than counters have their perfdoms rotated, one
+ * per frame, so a record's counters are deltas over the single frame that
+ * perfdom was counting for, with clk the domain clocks elapsed in it.
+ */
+struct trace_head {
+	char magic[4];
+#define TRACE_MAGIC "NVPM"
+	u16 version;
+	u16 perfdoms;
+	u32 rate;
+	u32 pad0c;
+};
+
+struct trace_dom {
+	u8   domain;
+	u8   counters;
+	u8   pad02[6];
+	char name[64];
+	char signal[4][64];
+};
+
+struct trace_rec {
+	u64 time;
+	u16 perfdom;
+	u8  pad0a[2];
+	u32 clk;
+	u32 ctr[4];
+};
+
+static int
+trace_select(int argc, char **argv)
+{
+	struct ui_perfmon_dom *dom;
+	struct ui_perfmon_sig *sig;
+	struct ui_main *item;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		bool found = false;
+
+		list_for_each_entry(dom, &ui_doms_list, head) {
+			list_for_each_entry(sig, &dom->signals, head) {
+				if (strcmp(sig->name, argv[i]))
+					continue;
+
+				item = calloc(1, sizeof(*item));
+				item->sig = sig;
+				list_add_tail(&item->head, &ui_main_list);
+				ui_perfdom_add(dom, item);
+				found = true;
+			}
+		}
+
+		if (!found) {
+			fprintf(stderr, "unknown signal %s\n", argv[i]);
+			return -EINVAL;
+		}
+	}
+
+	list_for_each_entry(dom, &ui_doms_list, head)
+		ui_perfdom_create(dom);
+	return 0;
+}
+
+static void
+trace_head(FILE *file, u32 rate)
+{
+	struct trace_head head = {
+		.magic = TRACE_MAGIC,
+		.perfdoms = ui_perfdom_nr,
+		.rate = rate,
+	};
+	struct ui_perfmon_dom *dom;
+	struct ui_perfdom *perfdom;
+	u16 index = 0;
+	int i;
+
+	fwrite(&head, sizeof(head), 1, file);
+
+	list_for_each_entry(dom, &ui_doms_list, head) {
+		list_for_each_entry(perfdom, &dom->perfdoms, head) {
+			struct trace_dom desc = {
+				.domain = dom->id,
+			};
+
+			strncpy(desc.name, dom->name, sizeof(desc.name));
+			for (i = 0; i < 4 && perfdom->ctr[i]; i++) {
+				strncpy(desc.signal[i],
+					perfdom->ctr[i]->sig->name,
+					sizeof(desc.signal[i]));
+			}
+			desc.counters = i;
+
+			perfdom->index = index++;
+			fwrite(&desc, sizeof(desc), 1, file);
+		}
+	}
+}
+
+static int
+trace_main(const char *path, u32 rate, u32 count, int argc, char **argv)
+{
+	struct nv_device_time_v0 time = {};
+	struct ui_perfmon_dom *dom;
+	struct ui_perfdom *perfdom;
+	struct ui_main *item, *temp;
+	struct u_period tick;
+	int time_ret, ret;
+	FILE *file;
+	u32 frame;
+
+	ret = trace_select(argc, argv);
+	if (ret)
+		return ret;
+
+	if (!ui_perfdom_nr) {
+		fprintf(stderr, "no signals to trace\n");
+		return -EINVAL;
+	}
+
+	fprintf(stderr, "%d signal(s) packed into %d perfdom(s)\n",
+		argc, ui_perfdom_nr);
+
+	if (!strcmp(path, "-"))
+		file = stdout;
+	else
+	if (!(file = fopen(path, "wb")))
+		return -errno;
+
+	trace_head(file, rate);
+
+	u_period_init(&tick, rate);
+	u_sample_catch();
+
+	/* the first frame only starts the counters, there's nothing to
+	 * read back from it, so it doesn't count towards the total
+	 */
+	for (frame = 0; !u_sample_stop && (!count || frame <= count); frame++) {
+		/* timestamp the frame in the same batch as its sample */
+		nvif_batch_mthd(&batch, &device->object, NV_DEVICE_V0_TIME,
+				&time, sizeof(time), &time_ret);
+		ui_perfmon_frame();
+
+		ret = nvif_batch_exec(&batch);
+		assert(ret == 0);
+		assert(time_ret == 0);
+		ui_perfmon_read_done();
+
+		list_for_each_entry(dom, &ui_doms_list, head) {
+			list_for_each_entry(perfdom, &dom->perfdoms, head) {
+				if (perfdom->read_ret == 0) {
+					struct trace_rec rec = {
+						.time = time.time,
+						.perfdom = perfdom->index,
+						.clk = perfdom->read.clk,
+					};
+					memcpy(rec.ctr, perfdom->read.ctr,
+					       sizeof(rec.ctr));
+					fwrite(&rec, sizeof(rec), 1, file);
+				}
+				ui_perfdom_done(perfdom);
+			}
+		}
+
+		u_period_wait(&tick);
+	}
+
+	if (file != stdout)
+		fclose(file);
+	else
+		fflush(file);
+
+	list_for_each_entry_safe(item, temp, &ui_main_list, head) {
+		ui_main_remove(item);
+	}
+	return 0;
+}
+
 int
 main(int argc, char **argv)
 {
+	const char *trace = NULL;
+	u32 rate = 10, count = 0;
 	int ret, c, k;
 	int scan = 0;
 
-	while ((c = getopt(argc, argv, "s"U_GETOPT)) != -1) {
+	while ((c = getopt(argc, argv, "f:n:st:"U_GETOPT)) != -1) {
 		switch (c) {
+		case 'f':
+			if (!u_sample_rate(optarg, &rate))
+				return 1;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
 		case 's':
 			scan = 1;
 			break;
+		case 't':
+			trace = optarg;
+			break;
 		default:
 			if (!u_option(c))
 				return 1;
@@ -844,6 +1152,15 @@ main(int argc, char **argv)
 
 	ui_perfmon_init();
 
+	if (trace) {
+		ret = trace_main(trace, rate, count, argc - optind,
+				 argv + optind);
+		ui_perfmon_fini();
+		nvif_device_fini(device);
+		nvif_client_fini(&client);
+		return ret ? 1 : 0;
+	}
+
 	initscr();
 	keypad(stdscr, TRUE);
 	nonl();
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+
+#include "util.h"
+
+/* checks and times the shim's red-black tree.  nodes are inserted with
+ * monotonically increasing keys, as object handles are, which is the case
+ * that degenerates an unbalanced tree into a list.  lookups of random keys
+ * are timed on the full tree, and its invariants are verified after each
+ * round of inserting or erasing nodes
+ */
+struct rbt_node {
+	struct rb_node rb;
+	u64 key;
+};
+
+static struct rbt_node *
+rbt_search(struct rb_root *root, u64 key)
+{
+	struct rb_node *node = root->rb_node;
+
+	while (node) {
+		struct rbt_node *rbt = container_of(node, typeof(*rbt), rb);
+		if (key < rbt->key)
+			node = node->rb_left;
+		else
+		if (key > rbt->key)
+			node = node->rb_right;
+		else
+			return rbt;
+	}
+
+	return NULL;
+}
+
+static void
+rbt_insert(struct rb_root *root, struct rbt_node *rbt)
+{
+	struct rb_node **ptr = &root->rb_node, *parent = NULL;
+
+	while (*ptr) {
+		struct rbt_node *this = container_of(*ptr, typeof(*this), rb);
+		parent = *ptr;
+		if (rbt->key < this->key)
+			ptr = &parent->rb_left;
+		else
+			ptr = &parent->rb_right;
+	}
+
+	rb_link_node(&rbt->rb, parent, ptr);
+	rb_insert_color(&rbt->rb, root);
+}
+
+/* returns the black height of the subtree, or -1 if it breaks ordering,
+ * parent links, the red rule or the black rule.  tracks the deepest path
+ */
+static int
+rbt_check(struct rb_node *node, struct rb_node *parent, u64 *min, u64 *max,
+	  int depth, int *deepest, unsigned long *count)
+{
+	struct rbt_node *rbt;
+	int l, r;
+
+	if (!node) {
+		*deepest = max(*deepest, depth);
+		return 1;
+	}
+
+	rbt = container_of(node, typeof(*rbt), rb);
+	if (node->parent != parent ||
+	    (min && rbt->key <= *min) || (max && rbt->key >= *max))
+		return -1;
+
+	if (node->rb_color == RB_RED && parent && parent->rb_color == RB_RED)
+		return -1;
+
+	l = rbt_check(node->rb_left, node, min, &rbt->key, depth + 1,
+		      deepest, count);
+	r = rbt_check(node->rb_right, node, &rbt->key, max, depth + 1,
+		      deepest, count);
+	if (l < 0 || l != r)
+		return -1;
+
+	(*count)++;
+	return l + (node->rb_color == RB_BLACK);
+}
+
+static bool
+rbt_verify(const char *name, struct rb_root *root, unsigned long expect)
+{
+	unsigned long count = 0;
+	int deepest = 0, height;
+	bool pass;
+
+	height = rbt_check(root->rb_node, NULL, NULL, NULL, 0, &deepest,
+			   &count);
+	pass = height >= 0 && count == expect &&
+	       (!root->rb_node || root->rb_node->rb_color == RB_BLACK);
+
+	printf("%-6s %7lu nodes, depth %2d, %s\n", name, count, deepest,
+	       pass ? "ok" : "FAILED");
+	return pass;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long count = 100000, lookups = 1000000, found = 0, tmp, i, j;
+	struct rb_root root = RB_ROOT;
+	struct rbt_node *nodes;
+	unsigned long *order;
+	u64 *keys, time;
+	bool pass = true;
+	int c;
+
+	while ((c = getopt(argc, argv, "l:n:")) != -1) {
+		switch (c) {
+		case 'l': lookups = strtoul(optarg, NULL, 0); break;
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!count || !lookups)
+		return 1;
+
+	nodes = calloc(count, sizeof(*nodes));
+	order = calloc(count, sizeof(*order));
+	keys = calloc(lookups, sizeof(*keys));
+	if (!nodes || !order || !keys)
+		return 1;
+
+	srand48(count);
+	for (i = 0; i < lookups; i++)
+		keys[i] = lrand48() % count;
+
+	time = ktime_get();
+	for (i = 0; i < count; i++) {
+		nodes[i].key = i;
+		rbt_insert(&root, &nodes[i]);
+	}
+	time = ktime_get() - time;
+	printf("insert %lluns per node\n", (unsigned long long)time / count);
+	pass &= rbt_verify("insert", &root, count);
+
+	time = ktime_get();
+	for (i = 0; i < lookups; i++)
+		found += rbt_search(&root, keys[i]) != NULL;
+	time = ktime_get() - time;
+	printf("lookup %lluns per key\n", (unsigned long long)time / lookups);
+	pass &= found == lookups;
+
+	/* erase a random half, put it back in the same random order, and
+	 * then erase everything in that order
+	 */
+	for (i = 0; i < count; i++)
+		order[i] = i;
+	for (i = count - 1; i > 0; i--) {
+		j = lrand48() % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < count / 2; i++)
+		rb_erase(&nodes[order[i]].rb, &root);
+	pass &= rbt_verify("erase", &root, count - count / 2);
+	for (i = 0; i < count / 2; i++)
+		rbt_insert(&root, &nodes[order[i]]);
+	pass &= rbt_verify("mixed", &root, count);
+	for (i = 0; i < count; i++)
+		rb_erase(&nodes[order[i]].rb, &root);
+	pass &= rbt_verify("empty", &root, 0);
+
+	free(order);
+	free(keys);
+	free(nodes);
+	return !pass;
+}
@@ -11,6 +11,7 @@
 #endif
 
 #include "util.h"
+#include "sample.h"
 
 int
 main(int argc, char **argv)
@@ -24,19 +25,25 @@ main(int argc, char **argv)
 		RATES,
 		WATCH,
 	} mode = NORMAL;
-	struct {
-		u64 addr;
-		u32 data;
-	} *data = NULL;
+	struct nvif_object_rwv *data = NULL;
+	const char *output = NULL;
+	bool binary = false, failed = false;
+	u32 rate = 0;
 	int mdata = 1;
 	int ndata = 0;
 	int ret, c;
 
-	while ((c = getopt(argc, argv, "-qrw"U_GETOPT)) != -1) {
+	while ((c = getopt(argc, argv, "-qrwf:o:x"U_GETOPT)) != -1) {
 		switch (c) {
 		case 'q': mode = QUIET; break;
 		case 'r': mode = RATES; break;
 		case 'w': mode = WATCH; break;
+		case 'f':
+			if (!u_sample_rate(optarg, &rate))
+				return 1;
+			break;
+		case 'o': output = optarg; break;
+		case 'x': binary = true; break;
 		case 1:
 			if (rstr)
 				return 1;
@@ -83,7 +90,12 @@ main(int argc, char **argv)
 
 			for (; cnt; cnt--, reg += sizeof(CAST)) {
 				data[ndata].addr = reg;
+				data[ndata].size = sizeof(CAST);
+				data[ndata].mask = (CAST)~0;
+				data[ndata].status = 0;
+#ifndef READV
 				data[ndata].data = READ(reg);
+#endif
 				ndata++;
 			}
 			break;
@@ -92,41 +104,89 @@ main(int argc, char **argv)
 		}
 	}
 
+#ifdef READV
+	/* accesses that failed are reported rather than printed, and
+	 * there's no point sampling a set of registers that can't be read
+	 */
+	if (READV(data, ndata)) {
+		for (c = 0; c < ndata; c++) {
+			if (data[c].status) {
+				fprintf(stderr, NAME" "FMTADDR" failed, %d\n",
+					data[c].addr, data[c].status);
+			}
+		}
+		if (mode == RATES || mode == WATCH)
+			return 1;
+		failed = true;
+	}
+#endif
+
 	switch (mode) {
 	case NORMAL:
 		for (c = 0; c < ndata; c++) {
+			if (data[c].status)
+				continue;
 			printf(NAME" "FMTADDR" "FMTDATA"\n",
 			       data[c].addr, data[c].data);
 		}
 		break;
 	case QUIET:
 		for (c = 0; c < ndata; c++) {
+			if (data[c].status)
+				continue;
 			printf(FMTDATA"\n", data[c].data);
 		}
 		break;
 	case RATES:
-		while (1) {
-			for (c = 0; c < ndata; c++) {
-				CAST next = READ(data[c].addr);
-				printf(NAME" "FMTADDR" "FMTDATA" "FMTDATA" %d/s\n",
-				       data[c].addr, data[c].data, next,
-				       next - data[c].data);
-				data[c].data = next;
-			}
-			sleep(1);
+	case WATCH: {
+		struct u_sample sample = {
+			.count = ndata,
+			.size = sizeof(CAST),
+			.watch = mode == WATCH,
+			.rate = rate ? rate : (mode == WATCH ? 1000 : 1),
+			.format = !output ? U_SAMPLE_TEXT :
+				  binary ? U_SAMPLE_BIN : U_SAMPLE_CSV,
+			.fmt_watch = NAME" "FMTADDR" "FMTDATA"\n",
+			.fmt_rates = NAME" "FMTADDR" "FMTDATA" "FMTDATA" %lld/s\n",
+		};
+		u64 *addr;
+
+		if (!(addr = malloc(sizeof(*addr) * ndata)))
+			return 1;
+		for (c = 0; c < ndata; c++)
+			addr[c] = data[c].addr;
+		sample.addr = addr;
+
+		if ((ret = u_sample_init(&sample, output))) {
+			free(addr);
+			return 1;
 		}
-		break;
-	case WATCH:
-		while (1) {
-			for (c = 0; c < ndata; c++) {
-				CAST next = READ(data[c].addr);
-				if (next != data[c].data) {
-					printf(NAME" "FMTADDR" "FMTDATA"\n",
-					       data[c].addr, next);
-					data[c].data = next;
+
+		while (!u_sample_stop) {
+			u32 *next = u_sample_next(&sample);
+			if (next) {
+				u64 time = nvif_device_time(device);
+#ifdef READV
+				if ((ret = READV(data, ndata))) {
+					fprintf(stderr, "sampling failed, %d\n",
+						ret);
+					failed = true;
+					break;
 				}
+				for (c = 0; c < ndata; c++)
+					next[c] = data[c].data;
+#else
+				for (c = 0; c < ndata; c++)
+					next[c] = READ(data[c].addr);
+#endif
+				u_sample_push(&sample, time);
 			}
+			u_sample_wait(&sample);
 		}
+
+		u_sample_fini(&sample);
+		free(addr);
+	}
 		break;
 	default:
 		assert(0);
@@ -136,5 +196,5 @@ main(int argc, char **argv)
 	free(data);
 	nvif_device_fini(device);
 	nvif_client_fini(&client);
-	return 0;
+	return failed;
 }
@@ -0,0 +1,39 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <nvif/client.h>
+#include <nvif/driver.h>
+
+#include "util.h"
+
+/* keeps a device initialised, and serves it to clients using the "shm"
+ * driver (-b shm, or the default driver selection)
+ */
+int
+main(int argc, char **argv)
+{
+	const char *drv;
+	int ret, c;
+
+	while ((c = getopt(argc, argv, U_GETOPT)) != -1) {
+		if (!u_option(c))
+			return 1;
+	}
+
+	drv = u_drv ? u_drv : "lib";
+	if (!strcmp(drv, "null")) {
+		os_device_detect = false;
+		os_device_mmio = false;
+		os_device_subdev = 0;
+	} else {
+		os_device_detect = true;
+		os_device_mmio = true;
+		os_device_subdev = ~0ULL;
+	}
+
+	ret = nvshm_server(drv, u_cfg, u_dbg ? u_dbg : "error");
+	if (ret)
+		fprintf(stderr, "server failed, %d\n", ret);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#include <core/mm.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* times allocation/free pairs with a fixed number of live objects, from
+ * a kmem_cache against malloc(), from several threads at once, and through
+ * nvkm_mm node allocation on a 4GiB heap of 4KiB blocks.  checks objects
+ * handed out are zeroed when asked and never handed out twice, and that
+ * the heap is clean once everything's been freed
+ */
+#define SLAB_LIVE 256
+#define SLAB_SIZE 64
+
+static struct {
+	struct kmem_cache *cache;
+	unsigned long loops;
+	unsigned long bad;
+} slab;
+
+struct slab_obj {
+	u64 magic;
+	u8 data[SLAB_SIZE - sizeof(u64)];
+};
+
+static void *
+slab_thread(void *arg)
+{
+	struct slab_obj *live[SLAB_LIVE] = {};
+	u64 magic[SLAB_LIVE], seed = (unsigned long)pthread_self();
+	bool cache = arg != NULL;
+	unsigned long bad = 0, i;
+
+	/* each allocation is stamped with a value unique to it, so an
+	 * object handed out twice is caught when the first user frees it
+	 */
+	for (i = 0; i < slab.loops; i++) {
+		struct slab_obj **obj = &live[i % SLAB_LIVE];
+
+		if (*obj) {
+			bad += (*obj)->magic != magic[i % SLAB_LIVE];
+			(*obj)->magic = 0;
+			if (cache)
+				kmem_cache_free(slab.cache, *obj);
+			else
+				free(*obj);
+		}
+
+		if (cache)
+			*obj = kmem_cache_zalloc(slab.cache, GFP_KERNEL);
+		else
+			*obj = calloc(1, sizeof(**obj));
+		if (!*obj || (*obj)->magic) {
+			bad++;
+			break;
+		}
+		(*obj)->magic = magic[i % SLAB_LIVE] = seed ^ (i << 1) ^ 1;
+	}
+
+	for (i = 0; i < SLAB_LIVE; i++) {
+		if (cache)
+			kmem_cache_free(slab.cache, live[i]);
+		else
+			free(live[i]);
+	}
+
+	__atomic_fetch_add(&slab.bad, bad, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static u64
+slab_run(unsigned long threads, bool cache)
+{
+	pthread_t thread[threads];
+	unsigned long i;
+	u64 time;
+
+	time = ktime_get();
+	for (i = 0; i < threads; i++) {
+		pthread_create(&thread[i], NULL, slab_thread,
+			       cache ? &slab : NULL);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	time = ktime_get() - time;
+	return time / (threads * slab.loops);
+}
+
+static int
+slab_mm(void)
+{
+	struct nvkm_mm_node *live[SLAB_LIVE] = {};
+	struct nvkm_mm mm = {};
+	unsigned long i;
+	u64 time;
+	int ret;
+
+	if ((ret = nvkm_mm_init(&mm, 0, 1 << 20, 1)))
+		return ret;
+
+	srand48(slab.loops);
+	time = ktime_get();
+	for (i = 0; i < slab.loops; i++) {
+		struct nvkm_mm_node **node = &live[i % SLAB_LIVE];
+		u32 size = 1 + lrand48() % 16;
+
+		nvkm_mm_free(&mm, node);
+		ret = nvkm_mm_head(&mm, 0, 1, size, size, 1, node);
+		if (ret)
+			break;
+	}
+	time = ktime_get() - time;
+
+	for (i = 0; i < SLAB_LIVE; i++)
+		nvkm_mm_free(&mm, &live[i]);
+	if (ret == 0)
+		ret = nvkm_mm_fini(&mm);
+	else
+		nvkm_mm_fini(&mm);
+
+	printf("nvkm_mm        %6lluns per head/free\n",
+	       (unsigned long long)time / slab.loops);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long threads = 4, i;
+	bool pass = true;
+	int ret, c;
+
+	slab.loops = 1000000;
+
+	while ((c = getopt(argc, argv, "n:t:")) != -1) {
+		switch (c) {
+		case 'n': slab.loops = strtoul(optarg, NULL, 0); break;
+		case 't': threads = strtoul(optarg, NULL, 0); break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!slab.loops || !threads)
+		return 1;
+
+	slab.cache = kmem_cache_create("nv_slab", sizeof(struct slab_obj), 0,
+				       0, NULL);
+	if (!slab.cache || nvkm_mm_cache_init()) {
+		fprintf(stderr, "cache init failed\n");
+		return 1;
+	}
+
+	for (i = 1; i <= threads; i *= 2) {
+		u64 cache = slab_run(i, true);
+		u64 heap = slab_run(i, false);
+		printf("%2lu thread(s):  %6lluns per kmem_cache pair, "
+		       "%6lluns per malloc pair\n", i,
+		       (unsigned long long)cache, (unsigned long long)heap);
+	}
+	printf("objects        %s\n", slab.bad ? "FAILED" : "ok");
+	pass &= !slab.bad;
+
+	ret = slab_mm();
+	printf("mm             %s\n", ret ? "FAILED" : "ok");
+	pass &= !ret;
+
+	nvkm_mm_cache_fini();
+	kmem_cache_destroy(slab.cache);
+	return !pass;
+}
@@ -0,0 +1,617 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <nvif/client.h>
+#include <nvif/device.h>
+#include <nvif/class.h>
+
+#include "util.h"
+
+/* a snapshot is a struct snap_head, then each range as a struct snap_range
+ * followed by its values, run-length encoded as a stream of u32 tokens:
+ *
+ *   SNAP_LIT | n, followed by n values
+ *   SNAP_RUN | n, followed by one value repeated n times
+ *   SNAP_BAD | n, for n registers that couldn't be read
+ *
+ * all in host byte order.  most of the register space reads back as long
+ * runs of zeroes or error patterns, which this squeezes out well enough
+ * without pulling in a compression library.
+ */
+struct snap_head {
+	char magic[4];
+#define SNAP_MAGIC "NVSN"
+	u16 version;
+	u8  pad06[2];
+	u32 ranges;
+	u8  pad0c[4];
+	u64 time;
+};
+
+struct snap_range {
+	u64 addr;
+	u32 count;
+	u32 words;
+};
+
+#define SNAP_LIT 0x00000000
+#define SNAP_RUN 0x40000000
+#define SNAP_BAD 0x80000000
+#define SNAP_CNT 0x3fffffff
+
+/* registers are read back this many at a time, nvif_object_rdv() splits
+ * them further into as many ioctls as the transport needs
+ */
+#define SNAP_CHUNK 4096
+
+struct range {
+	u64 addr;
+	u32 count;
+	u32 mask;
+	u32 *data;
+	u8  *bad;
+};
+
+struct ranges {
+	struct range *range;
+	int nr;
+	int max;
+};
+
+static void
+ranges_fini(struct ranges *list)
+{
+	int i;
+	for (i = 0; i < list->nr; i++) {
+		free(list->range[i].data);
+		free(list->range[i].bad);
+	}
+	free(list->range);
+	list->range = NULL;
+	list->nr = list->max = 0;
+}
+
+static struct range *
+ranges_add(struct ranges *list, u64 addr, u32 count, u32 mask)
+{
+	struct range *range;
+
+	if (list->nr == list->max) {
+		int max = list->max ? list->max << 1 : 16;
+		range = realloc(list->range, sizeof(*range) * max);
+		if (!range)
+			return NULL;
+		list->range = range;
+		list->max = max;
+	}
+
+	range = &list->range[list->nr++];
+	range->addr = addr;
+	range->count = count;
+	range->mask = mask;
+	range->data = NULL;
+	range->bad = NULL;
+	return range;
+}
+
+static int
+ranges_cmp(const void *a, const void *b)
+{
+	const struct range *ra = a, *rb = b;
+	return (ra->addr > rb->addr) - (ra->addr < rb->addr);
+}
+
+/* returns the range covering addr, with the list sorted by address */
+static struct range *
+ranges_find(struct ranges *list, u64 addr)
+{
+	int lo = 0, hi = list->nr - 1;
+
+	while (lo <= hi) {
+		int i = (lo + hi) / 2;
+		struct range *range = &list->range[i];
+		if (addr < range->addr)
+			hi = i - 1;
+		else
+		if (addr >= range->addr + range->count * 4ULL)
+			lo = i + 1;
+		else
+			return range;
+	}
+
+	return NULL;
+}
+
+/* parses "addr[/count|+bytes] [mask]", the same syntax as nv_rd32 uses for
+ * its register list, with an optional mask that's only used for diffs
+ */
+static int
+ranges_parse(struct ranges *list, char *rstr, bool mask)
+{
+	u64 addr, cnt = 1, bits = ~0U;
+	char *end;
+
+	addr = strtoull(rstr, &end, 0);
+	if (end == rstr || (addr & 3))
+		return -EINVAL;
+	rstr = end;
+
+	if (*rstr == '/') {
+		cnt = strtoul(rstr + 1, &end, 0);
+		if (end == rstr + 1)
+			return -EINVAL;
+		rstr = end;
+	} else
+	if (*rstr == '+') {
+		cnt = strtoul(rstr + 1, &end, 0) / 4;
+		if (end == rstr + 1)
+			return -EINVAL;
+		rstr = end;
+	}
+
+	if (mask && isspace(*rstr)) {
+		while (isspace(*rstr))
+			rstr++;
+		if (*rstr && *rstr != '#') {
+			bits = strtoul(rstr, &end, 0);
+			if (end == rstr)
+				return -EINVAL;
+			rstr = end;
+		}
+	}
+
+	while (isspace(*rstr))
+		rstr++;
+	if ((*rstr && *rstr != '#') || !cnt || cnt > SNAP_CNT)
+		return -EINVAL;
+
+	if (!ranges_add(list, addr, cnt, bits))
+		return -ENOMEM;
+	return 0;
+}
+
+/* a range list has one range per line, blank lines and anything following
+ * a '#' are ignored
+ */
+static int
+ranges_load(struct ranges *list, const char *path, bool mask)
+{
+	char line[256], *rstr;
+	int ret = 0, nr = 0;
+	FILE *file;
+
+	if (!(file = fopen(path, "r"))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		nr++;
+		for (rstr = line; isspace(*rstr); rstr++);
+		if (!*rstr || *rstr == '#')
+			continue;
+
+		if ((ret = ranges_parse(list, rstr, mask))) {
+			fprintf(stderr, "%s:%d: invalid range\n", path, nr);
+			break;
+		}
+	}
+
+	fclose(file);
+	return ret;
+}
+
+/*******************************************************************************
+ * Snapshot
+ ******************************************************************************/
+
+static int
+snap_read(struct nvif_device *device, struct range *range)
+{
+	struct nvif_object_rwv *op;
+	u32 i, j, nr;
+	int ret;
+
+	range->data = malloc(sizeof(*range->data) * range->count);
+	range->bad = malloc(sizeof(*range->bad) * range->count);
+	op = malloc(sizeof(*op) * SNAP_CHUNK);
+	if (!range->data || !range->bad || !op) {
+		free(op);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < range->count; i += nr) {
+		nr = min(range->count - i, SNAP_CHUNK);
+		for (j = 0; j < nr; j++) {
+			op[j].addr = range->addr + (i + j) * 4ULL;
+			op[j].size = 4;
+			op[j].mask = 0xffffffff;
+			op[j].data = 0x00000000;
+		}
+
+		/* individual failures are recorded, not fatal, but if nothing
+		 * in the chunk could be read, it's the read itself that failed
+		 */
+		if ((ret = nvif_object_rdv(&device->object, op, nr))) {
+			for (j = 0; j < nr && op[j].status == ret; j++);
+			if (j == nr) {
+				fprintf(stderr, "0x%06llx/%u: read failed, %d\n",
+					op[0].addr, nr, ret);
+				free(op);
+				return ret;
+			}
+		}
+
+		for (j = 0; j < nr; j++) {
+			range->data[i + j] = op[j].data;
+			range->bad[i + j] = op[j].status != 0;
+		}
+	}
+
+	free(op);
+	return 0;
+}
+
+/* encodes a range into tokens, runs shorter than this are left as literals
+ * as they wouldn't save anything
+ */
+#define SNAP_RUN_MIN 3
+
+static u32
+snap_encode(const struct range *range, u32 *out)
+{
+	u32 i = 0, words = 0, n;
+	u32 *lit = NULL;
+
+	for (i = 0; i < range->count; i += n) {
+		n = 1;
+		if (range->bad[i]) {
+			while (i + n < range->count && range->bad[i + n] &&
+			       n < SNAP_CNT)
+				n++;
+			out[words++] = SNAP_BAD | n;
+			lit = NULL;
+			continue;
+		}
+
+		while (i + n < range->count && !range->bad[i + n] &&
+		       range->data[i + n] == range->data[i] && n < SNAP_CNT)
+			n++;
+
+		if (n >= SNAP_RUN_MIN) {
+			out[words++] = SNAP_RUN | n;
+			out[words++] = range->data[i];
+			lit = NULL;
+			continue;
+		}
+
+		/* too short for a run, add them to the current literals */
+		while (n--) {
+			if (!lit || *lit == (SNAP_LIT | SNAP_CNT)) {
+				lit = &out[words++];
+				*lit = SNAP_LIT;
+			}
+			out[words++] = range->data[i++];
+			(*lit)++;
+		}
+		n = 0;
+	}
+
+	return words;
+}
+
+static int
+snap_decode(struct range *range, const u32 *in, u32 words)
+{
+	u32 i = 0, w = 0, n, j;
+
+	range->data = malloc(sizeof(*range->data) * range->count);
+	range->bad = calloc(range->count, sizeof(*range->bad));
+	if (!range->data || !range->bad)
+		return -ENOMEM;
+
+	while (w < words) {
+		u32 type = in[w] & ~SNAP_CNT;
+		n = in[w++] & SNAP_CNT;
+		if (n > range->count - i)
+			return -EINVAL;
+
+		switch (type) {
+		case SNAP_LIT:
+			if (n > words - w)
+				return -EINVAL;
+			memcpy(&range->data[i], &in[w], n * sizeof(*in));
+			w += n;
+			break;
+		case SNAP_RUN:
+			if (w == words)
+				return -EINVAL;
+			for (j = 0; j < n; j++)
+				range->data[i + j] = in[w];
+			w++;
+			break;
+		case SNAP_BAD:
+			memset(&range->data[i], 0x00, n * sizeof(*in));
+			memset(&range->bad[i], 0x01, n);
+			break;
+		default:
+			return -EINVAL;
+		}
+		i += n;
+	}
+
+	return i == range->count ? 0 : -EINVAL;
+}
+
+static int
+snap_save(const char *path, struct ranges *list, u64 time)
+{
+	struct snap_head head = {
+		.magic = SNAP_MAGIC,
+		.ranges = list->nr,
+		.time = time,
+	};
+	FILE *file;
+	u32 *temp = NULL;
+	int ret = 0, i;
+
+	if (!strcmp(path, "-"))
+		file = stdout;
+	else
+	if (!(file = fopen(path, "wb"))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	fwrite(&head, sizeof(head), 1, file);
+
+	for (i = 0; i < list->nr; i++) {
+		struct range *range = &list->range[i];
+		struct snap_range desc = {
+			.addr = range->addr,
+			.count = range->count,
+		};
+
+		/* worst case, alternating good and bad registers */
+		free(temp);
+		if (!(temp = malloc(sizeof(*temp) * (range->count * 2 + 1)))) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		desc.words = snap_encode(range, temp);
+		fwrite(&desc, sizeof(desc), 1, file);
+		fwrite(temp, sizeof(*temp), desc.words, file);
+	}
+
+	free(temp);
+	if (fflush(file) || ferror(file))
+		ret = -EIO;
+	if (file != stdout)
+		fclose(file);
+	return ret;
+}
+
+static int
+snap_load(const char *path, struct ranges *list)
+{
+	struct snap_head head;
+	struct snap_range desc;
+	u32 *temp = NULL;
+	FILE *file;
+	int ret = 0, i;
+
+	if (!(file = fopen(path, "rb"))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	if (fread(&head, sizeof(head), 1, file) != 1 ||
+	    memcmp(head.magic, SNAP_MAGIC, sizeof(head.magic)) ||
+	    head.version != 0) {
+		fprintf(stderr, "%s: not a snapshot\n", path);
+		fclose(file);
+		return -EINVAL;
+	}
+
+	for (i = 0; ret == 0 && i < head.ranges; i++) {
+		struct range *range;
+
+		if (fread(&desc, sizeof(desc), 1, file) != 1 ||
+		    desc.count > SNAP_CNT || desc.words > desc.count * 2 + 1) {
+			ret = -EINVAL;
+			break;
+		}
+
+		free(temp);
+		if (!(temp = malloc(sizeof(*temp) * (desc.words + 1))) ||
+		    !(range = ranges_add(list, desc.addr, desc.count, 0))) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (fread(temp, sizeof(*temp), desc.words, file) != desc.words)
+			ret = -EINVAL;
+		else
+			ret = snap_decode(range, temp, desc.words);
+	}
+
+	if (ret)
+		fprintf(stderr, "%s: corrupt snapshot, %d\n", path, ret);
+	free(temp);
+	fclose(file);
+
+	qsort(list->range, list->nr, sizeof(*list->range), ranges_cmp);
+	return ret;
+}
+
+/*******************************************************************************
+ * Diff
+ ******************************************************************************/
+
+static u32
+snap_mask(struct ranges *masks, u64 addr)
+{
+	struct range *range = ranges_find(masks, addr);
+	return range ? ~range->mask : 0xffffffff;
+}
+
+static void
+snap_show(u64 addr, struct range *a, struct range *b)
+{
+	u32 ia = a ? (addr - a->addr) / 4 : 0;
+	u32 ib = b ? (addr - b->addr) / 4 : 0;
+
+	printf("0x%06llx: ", addr);
+	if (!a)
+		printf("----------");
+	else
+	if (a->bad[ia])
+		printf("??????????");
+	else
+		printf("0x%08x", a->data[ia]);
+	printf(" -> ");
+	if (!b)
+		printf("----------");
+	else
+	if (b->bad[ib])
+		printf("??????????");
+	else
+		printf("0x%08x", b->data[ib]);
+	printf("\n");
+}
+
+/* shows every register that differs between the snapshots, ignoring the
+ * bits masked off for it, along with any only present in one of them
+ */
+static int
+snap_diff(struct ranges *a, struct ranges *b, struct ranges *masks)
+{
+	int diffs = 0, i;
+	u32 j;
+
+	for (i = 0; i < a->nr; i++) {
+		struct range *ra = &a->range[i];
+		for (j = 0; j < ra->count; j++) {
+			u64 addr = ra->addr + j * 4ULL;
+			struct range *rb = ranges_find(b, addr);
+			u32 mask = snap_mask(masks, addr);
+			u32 k;
+
+			if (!mask)
+				continue;
+
+			if (rb) {
+				k = (addr - rb->addr) / 4;
+				if (ra->bad[j] == rb->bad[k] &&
+				    !((ra->data[j] ^ rb->data[k]) & mask))
+					continue;
+			}
+
+			snap_show(addr, ra, rb);
+			diffs++;
+		}
+	}
+
+	for (i = 0; i < b->nr; i++) {
+		struct range *rb = &b->range[i];
+		for (j = 0; j < rb->count; j++) {
+			u64 addr = rb->addr + j * 4ULL;
+			if (ranges_find(a, addr) || !snap_mask(masks, addr))
+				continue;
+
+			snap_show(addr, NULL, rb);
+			diffs++;
+		}
+	}
+
+	return diffs;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nvif_client client;
+	struct nvif_device device;
+	struct ranges list = {}, other = {}, masks = {};
+	const char *rfile = NULL, *mfile = NULL, *output = NULL;
+	bool diff = false;
+	struct timespec t0, t1;
+	u64 regs = 0;
+	int ret, c, i;
+
+	while ((c = getopt(argc, argv, "m:o:r:x"U_GETOPT)) != -1) {
+		switch (c) {
+		case 'm': mfile = optarg; break;
+		case 'o': output = optarg; break;
+		case 'r': rfile = optarg; break;
+		case 'x': diff = true; break;
+		default:
+			if (!u_option(c))
+				return 1;
+			break;
+		}
+	}
+
+	if (diff) {
+		if (argc - optind != 2)
+			return 1;
+
+		if ((mfile && ranges_load(&masks, mfile, true)) ||
+		    snap_load(argv[optind + 0], &list) ||
+		    snap_load(argv[optind + 1], &other))
+			return 2;
+		qsort(masks.range, masks.nr, sizeof(*masks.range), ranges_cmp);
+
+		ret = snap_diff(&list, &other, &masks);
+		ranges_fini(&masks);
+		ranges_fini(&other);
+		ranges_fini(&list);
+		return ret ? 1 : 0;
+	}
+
+	if (!output)
+		return 1;
+
+	if (rfile && ranges_load(&list, rfile, false))
+		return 1;
+
+	for (i = optind; i < argc; i++) {
+		if (ranges_parse(&list, argv[i], false)) {
+			fprintf(stderr, "%s: invalid range\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!list.nr)
+		return 1;
+
+	ret = u_device("lib", argv[0], "error", false, true, 0,
+		       0x00000000, &client, &device);
+	if (ret)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < list.nr; i++) {
+		if ((ret = snap_read(&device, &list.range[i])))
+			break;
+		regs += list.range[i].count;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (ret == 0) {
+		ret = snap_save(output, &list, nvif_device_time(&device));
+		fprintf(stderr, "%llu registers in %d range(s), %lldms\n",
+			(unsigned long long)regs, list.nr,
+			((t1.tv_sec - t0.tv_sec) * 1000000000LL +
+			 (t1.tv_nsec - t0.tv_nsec)) / 1000000);
+	}
+
+	ranges_fini(&list);
+	nvif_device_fini(&device);
+	nvif_client_fini(&client);
+	return ret ? 1 : 0;
+}
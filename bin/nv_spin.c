@@ -0,0 +1,82 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* times spin_lock()/spin_unlock() pairs around a shared counter, with 1 to
+ * the given number of threads contending for the same lock, and checks no
+ * increments were lost.  builds with SPINLOCK=mutex and/or LOCKDEP=y can
+ * be compared against the default futex lock
+ */
+static struct {
+	spinlock_t lock;
+	unsigned long count;
+	unsigned long loops;
+	bool go;
+} spin;
+
+static void *
+spin_thread(void *arg)
+{
+	unsigned long i;
+
+	while (!__atomic_load_n(&spin.go, __ATOMIC_ACQUIRE))
+		cpu_relax();
+
+	for (i = 0; i < spin.loops; i++) {
+		spin_lock(&spin.lock);
+		spin.count++;
+		spin_unlock(&spin.lock);
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long threads = 8, nr, i;
+	pthread_t *thread;
+	bool pass = true;
+	u64 time;
+	int c;
+
+	spin.loops = 1000000;
+
+	while ((c = getopt(argc, argv, "n:t:")) != -1) {
+		switch (c) {
+		case 'n': spin.loops = strtoul(optarg, NULL, 0); break;
+		case 't': threads = strtoul(optarg, NULL, 0); break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!spin.loops || !threads)
+		return 1;
+
+	if (!(thread = calloc(threads, sizeof(*thread))))
+		return 1;
+
+	spin_lock_init(&spin.lock);
+	for (nr = 1; nr <= threads; nr++) {
+		spin.count = 0;
+		spin.go = false;
+		for (i = 0; i < nr; i++)
+			pthread_create(&thread[i], NULL, spin_thread, NULL);
+
+		time = ktime_get();
+		__atomic_store_n(&spin.go, true, __ATOMIC_RELEASE);
+		for (i = 0; i < nr; i++)
+			pthread_join(thread[i], NULL);
+		time = ktime_get() - time;
+
+		printf("%2lu thread(s): %6.1fns per lock/unlock, %s\n", nr,
+		       (double)time / (nr * spin.loops),
+		       spin.count == nr * spin.loops ? "ok" : "FAILED");
+		pass &= spin.count == nr * spin.loops;
+	}
+
+	free(thread);
+	return !pass;
+}
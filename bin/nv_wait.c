@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* checks that threads blocked in wait_event() and wait_event_timeout()
+ * sleep rather than poll, by measuring the process' cpu time across the
+ * waits.  covers a wait that times out, a wait that's woken before its
+ * timeout, and a wait that sees a burst of wakeups while its condition
+ * is still false, which must keep it asleep until the condition is met
+ */
+static struct {
+	wait_queue_head_t wq;
+	u32 delay;
+	u32 spurious;
+	bool cond;
+} wait;
+
+static void *
+wait_waker(void *arg)
+{
+	u32 i;
+
+	for (i = 0; i < wait.spurious; i++) {
+		usleep(wait.delay * 1000 / wait.spurious);
+		wake_up(&wait.wq);
+	}
+
+	usleep(wait.delay * 1000 / (wait.spurious + 1));
+	WRITE_ONCE(wait.cond, true);
+	wake_up(&wait.wq);
+	return NULL;
+}
+
+static bool
+wait_check(const char *name, u32 delay, u32 spurious, bool timed, bool woken)
+{
+	pthread_t thread;
+	u64 time, cpu;
+	long ret = 0;
+	bool pass;
+
+	wait.delay = delay;
+	wait.spurious = spurious;
+	wait.cond = false;
+	if (woken)
+		pthread_create(&thread, NULL, wait_waker, NULL);
+
+	time = ktime_get();
+	cpu = nvos_clock(CLOCK_PROCESS_CPUTIME_ID);
+	if (timed)
+		ret = wait_event_timeout(wait.wq, READ_ONCE(wait.cond),
+					 msecs_to_jiffies(2 * delay));
+	else
+		wait_event(wait.wq, READ_ONCE(wait.cond));
+	cpu = nvos_clock(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	time = ktime_get() - time;
+
+	if (woken)
+		pthread_join(thread, NULL);
+
+	/* the timeout is reported the way the kernel does, with the jiffies
+	 * left if the condition was met and zero if it wasn't.  the cpu
+	 * budget leaves room for the waker thread and for spurious wakeups,
+	 * but not for polling
+	 */
+	pass = READ_ONCE(wait.cond) == woken && (!timed || !ret == !woken) &&
+	       time >= delay * (woken ? 1000000ULL : 2000000ULL) &&
+	       cpu < time / 20 + spurious * 100000ULL;
+
+	printf("%-8s %5llums, %6lluus cpu, %s\n", name,
+	       (unsigned long long)time / 1000000,
+	       (unsigned long long)cpu / 1000, pass ? "ok" : "FAILED");
+	return pass;
+}
+
+int
+main(int argc, char **argv)
+{
+	u32 delay = 250;
+	bool pass = true;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:")) != -1) {
+		switch (c) {
+		case 't': delay = strtoul(optarg, NULL, 0); break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!delay)
+		return 1;
+
+	init_waitqueue_head(&wait.wq);
+	pass &= wait_check("timeout", delay, 0, true, false);
+	pass &= wait_check("timed", delay, 0, true, true);
+	pass &= wait_check("woken", delay, 0, false, true);
+	pass &= wait_check("spurious", delay, 100, false, true);
+	return !pass;
+}
@@ -0,0 +1,190 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* stresses the shim's workqueue the way many notifiers with work=true
+ * would, by scheduling a large set of work items repeatedly from several
+ * threads at once.  checks that an item never runs on two workers at the
+ * same time, that every successful schedule_work() is matched by exactly
+ * one run, that flush_work() leaves items idle, that handlers can requeue
+ * and free their own items, and that the pool doesn't grow threads
+ */
+struct work_item {
+	struct work_struct work;
+	unsigned long queued;
+	unsigned long runs;
+	int running;
+	int requeue;
+};
+
+static struct {
+	struct work_item *item;
+	unsigned long items;
+	unsigned long rounds;
+	unsigned long bad;
+	unsigned long freed;
+} work;
+
+static int
+work_threads(void)
+{
+	struct dirent *dirent;
+	DIR *dir;
+	int count = 0;
+
+	if (!(dir = opendir("/proc/self/task")))
+		return -1;
+	while ((dirent = readdir(dir))) {
+		if (dirent->d_name[0] != '.')
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+static void
+work_func(struct work_struct *w)
+{
+	struct work_item *item = container_of(w, typeof(*item), work);
+
+	if (__atomic_fetch_add(&item->running, 1, __ATOMIC_ACQ_REL))
+		__atomic_fetch_add(&work.bad, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&item->runs, 1, __ATOMIC_RELAXED);
+
+	if (item->requeue && item->requeue--)
+		schedule_work(&item->work);
+
+	__atomic_fetch_sub(&item->running, 1, __ATOMIC_ACQ_REL);
+}
+
+static void
+work_free(struct work_struct *w)
+{
+	free(container_of(w, struct work_item, work));
+	__atomic_fetch_add(&work.freed, 1, __ATOMIC_RELEASE);
+}
+
+static void *
+work_thread(void *arg)
+{
+	unsigned long seed = (unsigned long)arg, i, j, k;
+	long threads = 0;
+
+	for (i = 0; i < work.rounds; i++) {
+		for (j = 0; j < work.items; j++) {
+			k = (j * 7919 + seed) % work.items;
+			if (schedule_work(&work.item[k].work))
+				__atomic_fetch_add(&work.item[k].queued, 1,
+						   __ATOMIC_RELAXED);
+		}
+
+		threads = max(threads, (long)work_threads());
+	}
+
+	return (void *)threads;
+}
+
+static bool
+work_check(const char *name, bool pass)
+{
+	printf("%-8s %s\n", name, pass ? "ok" : "FAILED");
+	return pass;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long queued = 0, runs = 0, busy = 0, i;
+	long submitters = 4, threads = 0, base;
+	pthread_t *thread;
+	void *most;
+	bool pass = true;
+	u64 time;
+	int c;
+
+	work.items = 10000;
+	work.rounds = 80;
+
+	while ((c = getopt(argc, argv, "n:r:t:")) != -1) {
+		switch (c) {
+		case 'n': work.items = strtoul(optarg, NULL, 0); break;
+		case 'r': work.rounds = strtoul(optarg, NULL, 0); break;
+		case 't': submitters = strtol(optarg, NULL, 0); break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!work.items || !work.rounds || submitters < 1)
+		return 1;
+
+	work.item = calloc(work.items, sizeof(*work.item));
+	thread = calloc(submitters, sizeof(*thread));
+	if (!work.item || !thread)
+		return 1;
+
+	for (i = 0; i < work.items; i++)
+		INIT_WORK(&work.item[i].work, work_func);
+
+	/* the pool is started by the first schedule_work() */
+	base = work_threads();
+	schedule_work(&work.item[0].work);
+	flush_work(&work.item[0].work);
+	work.item[0].queued++;
+
+	time = ktime_get();
+	for (i = 0; i < submitters; i++)
+		pthread_create(&thread[i], NULL, work_thread, (void *)i);
+	for (i = 0; i < submitters; i++) {
+		pthread_join(thread[i], &most);
+		threads = max(threads, (long)most);
+	}
+	for (i = 0; i < work.items; i++)
+		flush_work(&work.item[i].work);
+	time = ktime_get() - time;
+
+	for (i = 0; i < work.items; i++) {
+		struct work_item *item = &work.item[i];
+		queued += item->queued;
+		runs += item->runs;
+		busy += item->work.flags || item->running ||
+			item->queued != item->runs;
+	}
+
+	printf("%lu items x %lu rounds from %ld threads: %lu queued, "
+	       "%lu runs, %lluns per run\n", work.items, work.rounds,
+	       submitters, queued, runs, (unsigned long long)time / runs);
+	pass &= work_check("serial", !work.bad);
+	pass &= work_check("runs", !busy && queued == runs);
+	pass &= work_check("threads", threads <= base + 4 + submitters);
+
+	/* an item requeued from its own handler runs again, on whichever
+	 * worker is free, and flush waits for the last of those runs
+	 */
+	memset(&work.item[0], 0x00, sizeof(work.item[0]));
+	INIT_WORK(&work.item[0].work, work_func);
+	work.item[0].requeue = 1000;
+	schedule_work(&work.item[0].work);
+	flush_work(&work.item[0].work);
+	pass &= work_check("requeue", work.item[0].runs == 1001 && !work.bad);
+
+	/* handlers may free their own item, the pool mustn't touch it after */
+	for (i = 0; i < work.items; i++) {
+		struct work_item *item = malloc(sizeof(*item));
+		if (!item)
+			return 1;
+		INIT_WORK(&item->work, work_free);
+		schedule_work(&item->work);
+	}
+	time = ktime_get() + 10 * NSEC_PER_SEC;
+	while (__atomic_load_n(&work.freed, __ATOMIC_ACQUIRE) != work.items &&
+	       ktime_get() < time)
+		usleep(1000);
+	pass &= work_check("free", work.freed == work.items);
+
+	free(thread);
+	free(work.item);
+	return !pass;
+}
@@ -3,5 +3,6 @@
 #define NAME       "nv_wr08"
 #define CAST       u8
 #define WRITE(o,v) nvif_wr08(&device->object, (o), (v))
+#define WRITEV(d,n) nvif_object_wrv(&device->object, (d), (n))
 #define MAIN       main
 #include "nv_wrfunc.h"
@@ -3,5 +3,6 @@
 #define NAME       "nv_wr16"
 #define CAST       u16
 #define WRITE(o,v) nvif_wr16(&device->object, (o), (v))
+#define WRITEV(d,n) nvif_object_wrv(&device->object, (d), (n))
 #define MAIN       main
 #include "nv_wrfunc.h"
@@ -19,6 +19,11 @@ MAIN(int argc, char **argv)
 	struct nvif_device _device, *device = &_device;
 	char *rstr = NULL;
 	char *vstr = NULL;
+#ifdef WRITEV
+	struct nvif_object_rwv *data = NULL;
+	int mdata = 1;
+	int ndata = 0;
+#endif
 	int quiet = 0;
 	int ret, c;
 
@@ -78,10 +83,26 @@ MAIN(int argc, char **argv)
 		case ',':
 			rstr++;
 		case '\0':
+#ifdef WRITEV
+			if (ndata + cnt >= mdata) {
+				while (ndata + cnt > mdata)
+					mdata <<= 1;
+				data = realloc(data, sizeof(*data) * mdata);
+				assert(data);
+			}
+#endif
 			while (cnt--) {
 				if (!quiet)
 					printk(NAME" "FMTADDR" "FMTDATA"\n", reg, (CAST)val);
+#ifdef WRITEV
+				data[ndata].addr = reg;
+				data[ndata].size = sizeof(CAST);
+				data[ndata].mask = (CAST)~0;
+				data[ndata].data = (CAST)val;
+				ndata++;
+#else
 				WRITE(reg, val);
+#endif
 				reg += sizeof(CAST);
 			}
 			break;
@@ -90,6 +111,11 @@ MAIN(int argc, char **argv)
 		}
 	}
 
+#ifdef WRITEV
+	WRITEV(data, ndata);
+	free(data);
+#endif
+
 	nvif_device_fini(device);
 	nvif_client_fini(&client);
 	return 0;
@@ -0,0 +1,362 @@
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+#include <nvif/device.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* samples a set of registers at a fixed frequency, timestamped with the
+ * GPU's own timer.  the sampling loop only reads registers and copies
+ * them into a preallocated ring, formatting and writing them out is left
+ * to a separate thread so it doesn't perturb the sampling.
+ *
+ * the binary stream is a struct u_sample_head, then one record per sample
+ * of a u64 timestamp followed by each register's value in head.size bytes,
+ * all in host byte order.  in watch mode, only the first sample and those
+ * where something changed are written out.
+ */
+struct u_sample_head {
+	char magic[4];
+#define U_SAMPLE_MAGIC "NVRS"
+	u16 version;
+	u8  size;
+	u8  watch;
+	u32 count;
+	u32 rate;
+	u64 addr[];
+};
+
+enum u_sample_format {
+	U_SAMPLE_TEXT,
+	U_SAMPLE_CSV,
+	U_SAMPLE_BIN,
+};
+
+/* below this period the sampling loop spins rather than sleeping */
+#define U_SAMPLE_SPIN 200000ULL
+
+static volatile sig_atomic_t u_sample_stop;
+
+static void
+u_sample_signal(int sig)
+{
+	u_sample_stop = 1;
+}
+
+/* SIGINT/SIGTERM end sampling loops gracefully rather than killing them */
+static inline void
+u_sample_catch(void)
+{
+	struct sigaction sa = { .sa_handler = u_sample_signal };
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+}
+
+/* a sampling period is a whole number of nanoseconds, so faster rates
+ * than this can't be honoured
+ */
+#define U_SAMPLE_RATE_MAX 1000000000UL
+
+/* parses a -f argument, rejecting rates the period can't represent */
+static inline bool
+u_sample_rate(const char *arg, u32 *rate)
+{
+	unsigned long val;
+	char *end;
+
+	val = strtoul(arg, &end, 0);
+	if (end == arg || *end || !val || val > U_SAMPLE_RATE_MAX)
+		return false;
+	*rate = val;
+	return true;
+}
+
+struct u_period {
+	u64 period;
+	struct timespec next;
+};
+
+static inline void
+u_period_init(struct u_period *p, u32 rate)
+{
+	p->period = 1000000000ULL / rate;
+	clock_gettime(CLOCK_MONOTONIC, &p->next);
+}
+
+/* waits for the next sampling period, sleeping when the period is long
+ * enough for the wakeup latency not to matter, and skipping any periods
+ * that have already been missed entirely
+ */
+static inline void
+u_period_wait(struct u_period *p)
+{
+	struct timespec now;
+	u64 next, time;
+
+	next = p->next.tv_sec * 1000000000ULL + p->next.tv_nsec + p->period;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	if (time > next)
+		next = time - (time - next) % p->period + p->period;
+
+	p->next.tv_sec = next / 1000000000ULL;
+	p->next.tv_nsec = next % 1000000000ULL;
+
+	if (p->period >= U_SAMPLE_SPIN) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &p->next, NULL) == EINTR) {
+			if (u_sample_stop)
+				return;
+		}
+	} else {
+		do {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+		} while (time < next && !u_sample_stop);
+	}
+}
+
+struct u_sample {
+	const u64 *addr;
+	u32 count;
+	u8  size;
+	bool watch;
+	u32 rate;
+	enum u_sample_format format;
+	FILE *file;
+	const char *fmt_watch;
+	const char *fmt_rates;
+
+	u64 *time;
+	u32 *data;
+	u32 depth;
+	u32 get;
+	u32 put;
+	u64 lost;
+
+	u64 last_time;
+	u32 *last;
+	bool first;
+
+	struct u_period tick;
+
+	pthread_t thread;
+	bool running;
+	bool fini;
+};
+
+/* ring is sized to roughly this many bytes of samples */
+#define U_SAMPLE_RING (16 << 20)
+
+static inline u32 *
+u_sample_slot(struct u_sample *s, u32 index)
+{
+	return &s->data[(index & (s->depth - 1)) * s->count];
+}
+
+static void
+u_sample_text(struct u_sample *s, u64 time, const u32 *data)
+{
+	u32 i;
+
+	for (i = 0; i < s->count; i++) {
+		if (s->watch) {
+			if (data[i] != s->last[i])
+				fprintf(s->file, s->fmt_watch, s->addr[i], data[i]);
+		} else {
+			u64 dt = time - s->last_time;
+			u32 mask = 0xffffffff >> (32 - s->size * 8);
+			u32 diff = (data[i] - s->last[i]) & mask;
+			fprintf(s->file, s->fmt_rates, s->addr[i], s->last[i],
+				data[i], dt ? ((long long)diff * 1000000000 + dt / 2) / dt : 0);
+		}
+	}
+}
+
+static void
+u_sample_csv(struct u_sample *s, u64 time, const u32 *data)
+{
+	u32 i;
+
+	fprintf(s->file, "%llu", (unsigned long long)time);
+	for (i = 0; i < s->count; i++)
+		fprintf(s->file, ",0x%0*x", s->size * 2, data[i]);
+	fputc('\n', s->file);
+}
+
+static void
+u_sample_bin(struct u_sample *s, u64 time, const u32 *data)
+{
+	u8  temp[sizeof(u64) + 4 * s->count], *ptr = temp + sizeof(u64);
+	u32 i;
+
+	memcpy(temp, &time, sizeof(time));
+	for (i = 0; i < s->count; i++, ptr += s->size) {
+		switch (s->size) {
+		case 1: *ptr = data[i]; break;
+		case 2: *(u16 *)ptr = data[i]; break;
+		default:
+			*(u32 *)ptr = data[i];
+			break;
+		}
+	}
+
+	fwrite(temp, ptr - temp, 1, s->file);
+}
+
+static void
+u_sample_write(struct u_sample *s, u64 time, const u32 *data)
+{
+	if (!s->first) {
+		if (s->format == U_SAMPLE_TEXT) {
+			u_sample_text(s, time, data);
+		} else {
+			if (s->watch &&
+			    !memcmp(s->last, data, s->count * sizeof(*data)))
+				return;
+			if (s->format == U_SAMPLE_CSV)
+				u_sample_csv(s, time, data);
+			else
+				u_sample_bin(s, time, data);
+		}
+	} else {
+		s->first = false;
+		if (s->format == U_SAMPLE_CSV)
+			u_sample_csv(s, time, data);
+		if (s->format == U_SAMPLE_BIN)
+			u_sample_bin(s, time, data);
+	}
+
+	s->last_time = time;
+	memcpy(s->last, data, s->count * sizeof(*data));
+}
+
+static void *
+u_sample_writer(void *arg)
+{
+	struct u_sample *s = arg;
+	u32 put;
+
+	for (;;) {
+		put = __atomic_load_n(&s->put, __ATOMIC_ACQUIRE);
+		if (s->get == put) {
+			if (__atomic_load_n(&s->fini, __ATOMIC_ACQUIRE) &&
+			    put == __atomic_load_n(&s->put, __ATOMIC_ACQUIRE))
+				break;
+			fflush(s->file);
+			usleep(1000);
+			continue;
+		}
+
+		while (s->get != put) {
+			u_sample_write(s, s->time[s->get & (s->depth - 1)],
+				       u_sample_slot(s, s->get));
+			__atomic_store_n(&s->get, s->get + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	fflush(s->file);
+	return NULL;
+}
+
+static inline u32 *
+u_sample_next(struct u_sample *s)
+{
+	u32 get = __atomic_load_n(&s->get, __ATOMIC_ACQUIRE);
+	if (s->put - get == s->depth) {
+		s->lost++;
+		return NULL;
+	}
+	return u_sample_slot(s, s->put);
+}
+
+static inline void
+u_sample_push(struct u_sample *s, u64 time)
+{
+	s->time[s->put & (s->depth - 1)] = time;
+	__atomic_store_n(&s->put, s->put + 1, __ATOMIC_RELEASE);
+}
+
+static inline void
+u_sample_wait(struct u_sample *s)
+{
+	u_period_wait(&s->tick);
+}
+
+static inline void
+u_sample_fini(struct u_sample *s)
+{
+	if (s->running) {
+		__atomic_store_n(&s->fini, true, __ATOMIC_RELEASE);
+		pthread_join(s->thread, NULL);
+		if (s->lost)
+			fprintf(stderr, "%llu samples lost\n",
+				(unsigned long long)s->lost);
+	}
+	if (s->file && s->file != stdout)
+		fclose(s->file);
+	free(s->last);
+	free(s->time);
+	free(s->data);
+	s->running = false;
+	s->file = NULL;
+}
+
+static inline int
+u_sample_init(struct u_sample *s, const char *path)
+{
+	u32 record = sizeof(u64) + s->count * sizeof(u32);
+
+	s->depth = 16;
+	while (s->depth * 2 * record <= U_SAMPLE_RING)
+		s->depth *= 2;
+
+	s->file = stdout;
+	if (path && strcmp(path, "-") && !(s->file = fopen(path, "wb")))
+		return -errno;
+
+	s->time = calloc(s->depth, sizeof(*s->time));
+	s->data = calloc(s->depth, s->count * sizeof(*s->data));
+	s->last = calloc(s->count, sizeof(*s->last));
+	if (!s->time || !s->data || !s->last) {
+		u_sample_fini(s);
+		return -ENOMEM;
+	}
+	s->first = true;
+
+	if (s->format == U_SAMPLE_CSV) {
+		u32 i;
+		fprintf(s->file, "time");
+		for (i = 0; i < s->count; i++)
+			fprintf(s->file, ",0x%llx", (unsigned long long)s->addr[i]);
+		fputc('\n', s->file);
+	} else
+	if (s->format == U_SAMPLE_BIN) {
+		struct u_sample_head head = {
+			.version = 0,
+			.size = s->size,
+			.watch = s->watch,
+			.count = s->count,
+			.rate = s->rate,
+		};
+		memcpy(head.magic, U_SAMPLE_MAGIC, sizeof(head.magic));
+		fwrite(&head, sizeof(head), 1, s->file);
+		fwrite(s->addr, sizeof(*s->addr), s->count, s->file);
+	}
+
+	u_period_init(&s->tick, s->rate);
+	u_sample_catch();
+
+	if (pthread_create(&s->thread, NULL, u_sample_writer, s)) {
+		u_sample_fini(s);
+		return -ENOMEM;
+	}
+
+	s->running = true;
+	return 0;
+}
+#endif
@@ -39,54 +39,75 @@ u_client(const char *drv, const char *name, const char *dbg,
 				u_dbg ? u_dbg : dbg, client);
 }
 
+/* room for the device list of most systems, so it can be queried on the
+ * stack in a single call, larger lists are allocated and must be freed
+ * with u_device_list_put()
+ */
+struct u_device_list {
+	struct nv_client_devlist_v0 args;
+	u64 device[16];
+};
+
 static inline struct nv_client_devlist_v0 *
-u_device_list(struct nvif_client *client)
+u_device_list(struct nvif_client *client, struct u_device_list *list)
 {
 	struct nvif_object *object = &client->object;
-	struct nv_client_devlist_v0 *args;
-	int count = 0;
+	struct nv_client_devlist_v0 *args = &list->args;
+	int count = ARRAY_SIZE(list->device);
 
 	for (;;) {
 		u32 size = sizeof(*args) + count * sizeof(args->device[0]);
-		if (!(args = malloc(size)))
-			return NULL;
 		args->version = 0;
 		args->count = count;
 
 		if (nvif_object_mthd(object, NV_CLIENT_DEVLIST, args, size)) {
-			free(args);
+			if (args != &list->args)
+				free(args);
 			return NULL;
 		}
 
-		if (args->count == count)
+		if (args->count <= count)
 			return args;
 		count = args->count;
-		free(args);
+		if (args != &list->args)
+			free(args);
+		if (!(args = malloc(sizeof(*args) +
+				    count * sizeof(args->device[0]))))
+			return NULL;
 	}
 }
 
+static inline void
+u_device_list_put(struct u_device_list *list, struct nv_client_devlist_v0 *args)
+{
+	if (args != &list->args)
+		free(args);
+}
+
 static inline void
 u_device_show(struct nvif_client *client)
 {
-	struct nv_client_devlist_v0 *args = u_device_list(client);
+	struct u_device_list list;
+	struct nv_client_devlist_v0 *args = u_device_list(client, &list);
 	int i;
 	printf("device(s):\n");
 	for (i = 0; args && i < args->count; i++)
 		printf("%2d: %016llx\n", i, args->device[i]);
-	free(args);
+	u_device_list_put(&list, args);
 }
 
 static inline u64
 u_device_name(struct nvif_client *client, int idx)
 {
-	struct nv_client_devlist_v0 *args = u_device_list(client);
+	struct u_device_list list;
+	struct nv_client_devlist_v0 *args = u_device_list(client, &list);
 	u64 device = ~0ULL;
 	if (args) {
 		if (idx >= 0 && idx < args->count)
 			device = args->device[idx];
 		else
 			u_device_show(client);
-		free(args);
+		u_device_list_put(&list, args);
 	}
 	return device;
 }
@@ -103,8 +124,14 @@ u_device(const char *drv, const char *name, const char *dbg,
 					.device = u_device_name(client, u_dev),
 				       }, sizeof(struct nv_device_v0),
 				       pdevice);
-		if (ret)
+		if (ret) {
 			nvif_client_fini(client);
+			return ret;
+		}
+
+		/* not fatal, accesses fall back to ioctls if it fails */
+		if (mmio)
+			nvif_object_map(&pdevice->object);
 	}
 	return ret;
 }
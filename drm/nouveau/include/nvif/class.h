@@ -270,6 +270,7 @@ struct gf119_dma_v0 {
 #define NVIF_PERFMON_V0_QUERY_DOMAIN                                       0x00
 #define NVIF_PERFMON_V0_QUERY_SIGNAL                                       0x01
 #define NVIF_PERFMON_V0_QUERY_SOURCE                                       0x02
+#define NVIF_PERFMON_V0_READ_ALL                                           0x03
 
 struct nvif_perfmon_query_domain_v0 {
 	__u8  version;
@@ -302,6 +303,18 @@ struct nvif_perfmon_query_source_v0 {
 	char  name[64];
 };
 
+struct nvif_perfmon_read_all_v0 {
+	__u8  version;
+	__u8  pad01[3];
+	__u32 count;
+	struct {
+		__u64 object;
+		__u32 ctr[4];
+		__u32 clk;
+		__u8  pad1c[4];
+	} dom[];
+};
+
 
 /*******************************************************************************
  * perfdom
@@ -11,6 +11,7 @@ struct nvif_driver {
 	int (*ioctl)(void *priv, bool super, void *data, u32 size, void **hack);
 	void __iomem *(*map)(void *priv, u64 handle, u32 size);
 	void (*unmap)(void *priv, void __iomem *ptr, u32 size);
+	u32 ioctl_max; /* largest request ioctl() accepts, 0 if unlimited */
 	bool keep;
 };
 
@@ -18,5 +19,6 @@ extern const struct nvif_driver nvif_driver_nvkm;
 extern const struct nvif_driver nvif_driver_drm;
 extern const struct nvif_driver nvif_driver_lib;
 extern const struct nvif_driver nvif_driver_null;
+extern const struct nvif_driver nvif_driver_shm;
 
 #endif
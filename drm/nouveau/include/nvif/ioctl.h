@@ -18,6 +18,9 @@ struct nvif_ioctl_v0 {
 #define NVIF_IOCTL_V0_NTFY_DEL                                             0x0a
 #define NVIF_IOCTL_V0_NTFY_GET                                             0x0b
 #define NVIF_IOCTL_V0_NTFY_PUT                                             0x0c
+#define NVIF_IOCTL_V0_RDV                                                  0x0d
+#define NVIF_IOCTL_V0_WRV                                                  0x0e
+#define NVIF_IOCTL_V0_BATCH                                                0x0f
 	__u8  type;
 	__u8  pad02[4];
 #define NVIF_IOCTL_V0_OWNER_NVIF                                           0x00
@@ -88,6 +91,35 @@ struct nvif_ioctl_wr_v0 {
 	__u64 addr;
 };
 
+struct nvif_ioctl_rwv_v0 {
+	/* nvif_ioctl ... */
+	__u8  version;
+	__u8  pad01[3];
+	__u32 count;
+	struct nvif_ioctl_rwv_op_v0 {
+		__u8  size;
+		__u8  pad01[3];
+		__s32 status;
+		__u64 addr;
+		__u32 mask;
+		__u32 data;
+	} op[];
+};
+
+struct nvif_ioctl_batch_v0 {
+	/* nvif_ioctl ... */
+	__u8  version;
+	__u8  pad01[3];
+	__u32 count;
+	__u8  data[];		/* nvif_ioctl_batch_rec_v0[count] */
+};
+
+struct nvif_ioctl_batch_rec_v0 {
+	__u32 size;		/* of data, records are padded to 8 bytes */
+	__s32 ret;
+	__u8  data[];		/* nvif_ioctl_v0 ... */
+};
+
 struct nvif_ioctl_map_v0 {
 	/* nvif_ioctl ... */
 	__u8  version;
@@ -9,6 +9,20 @@ struct nvif_sclass {
 	int maxver;
 };
 
+struct nvif_object_rwv {
+	u64 addr;
+	u32 data;
+	u32 mask;
+	u8  size;
+	int status;
+};
+
+/* an argument fragment for nvif_object_ioctlv() */
+struct nvif_ioctlv {
+	void *data;
+	u32 size;
+};
+
 struct nvif_object {
 	struct nvif_client *client;
 	u32 handle;
@@ -18,17 +32,54 @@ struct nvif_object {
 		void __iomem *ptr;
 		u32 size;
 	} map;
+	struct {
+		struct nvif_sclass *data;
+		int count;
+	} sclass;
 };
 
 int  nvif_object_init(struct nvif_object *, u32 handle, s32 oclass, void *, u32,
 		      struct nvif_object *);
 void nvif_object_fini(struct nvif_object *);
 int  nvif_object_ioctl(struct nvif_object *, void *, u32, void **);
+int  nvif_object_ioctlv(struct nvif_object *, void *, u32,
+			const struct nvif_ioctlv *, int, void **);
+int  nvif_object_sclass(struct nvif_object *, const struct nvif_sclass **);
 int  nvif_object_sclass_get(struct nvif_object *, struct nvif_sclass **);
 void nvif_object_sclass_put(struct nvif_sclass **);
 u32  nvif_object_rd(struct nvif_object *, int, u64);
 void nvif_object_wr(struct nvif_object *, int, u64, u32);
+int  nvif_object_rdv(struct nvif_object *, struct nvif_object_rwv *, u32);
+int  nvif_object_wrv(struct nvif_object *, struct nvif_object_rwv *, u32);
 int  nvif_object_mthd(struct nvif_object *, u32, void *, u32);
+
+/* a batch packs any number of ioctls into a single submission, they're
+ * executed in order, and each record's arguments and return code are
+ * written back once the batch has been executed
+ */
+struct nvif_batch {
+	struct nvif_client *client;
+	u8  *data;
+	u32  size;
+	u32  limit;
+	struct nvif_batch_rec {
+		void *data;
+		u32   size;
+		u32   skip;
+		int  *ret;
+	} *rec;
+	u32  count;
+	u32  slots;
+	int  ret;
+};
+
+void nvif_batch_init(struct nvif_batch *, struct nvif_client *);
+void nvif_batch_fini(struct nvif_batch *);
+void nvif_batch_ioctl(struct nvif_batch *, struct nvif_object *,
+		      void *, u32, int *);
+void nvif_batch_mthd(struct nvif_batch *, struct nvif_object *, u32 mthd,
+		     void *, u32, int *);
+int  nvif_batch_exec(struct nvif_batch *);
 int  nvif_object_map(struct nvif_object *);
 void nvif_object_unmap(struct nvif_object *);
 
@@ -20,6 +20,8 @@
 #include <linux/reboot.h>
 #include <linux/interrupt.h>
 #include <linux/log2.h>
+#include <linux/hash.h>
+#include <linux/rculist.h>
 #include <linux/pm_runtime.h>
 #include <linux/power_supply.h>
 #include <linux/clk.h>
@@ -4,12 +4,25 @@
 
 struct nvkm_client {
 	struct nvkm_object object;
+	struct mutex mutex;
 	char name[32];
 	u64 device;
 	u32 debug;
 
-	struct nvkm_client_notify *notify[16];
+	struct nvkm_client_notify **notify;
+	int notify_nr;
+	u32 notify_serial;
+	struct nvkm_client_ring *ring;
 	struct rb_root objroot;
+	struct {
+		struct nvkm_client_hash {
+			u64 handle;
+			struct nvkm_object *object;
+		} *slot;
+		u32 bits;
+		u32 count;
+		bool partial;
+	} objhash;
 	struct rb_root dmaroot;
 
 	bool super;
@@ -35,6 +48,12 @@ int nvkm_client_notify_del(struct nvkm_client *, int index);
 int nvkm_client_notify_get(struct nvkm_client *, int index);
 int nvkm_client_notify_put(struct nvkm_client *, int index);
 
+int  nvkm_client_ring_new(struct nvkm_client *, int order);
+int  nvkm_client_ring_drain(struct nvkm_client *, int budget);
+void nvkm_client_ring_flush(struct nvkm_client *);
+bool nvkm_client_ring_wait(struct nvkm_client *, long timeout);
+void nvkm_client_ring_kick(struct nvkm_client *);
+
 /* logging for client-facing objects */
 #define nvif_printk(o,l,p,f,a...) do {                                         \
 	struct nvkm_object *_object = (o);                                     \
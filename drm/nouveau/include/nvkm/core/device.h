@@ -68,6 +68,7 @@ struct nvkm_device {
 	const char *dbgopt;
 
 	struct list_head head;
+	bool constructed;
 	struct mutex mutex;
 	int refcount;
 
@@ -221,12 +222,34 @@ struct nvkm_device *nvkm_device_find(u64 name);
 int nvkm_device_list(u64 *name, int size);
 
 /* privileged register interface accessor macros */
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+/* accesses are routed through functions that can record them, or serve
+ * them from a previous recording, the current subdev is tagged on each
+ */
+u32  nvkm_mmio_rd(struct nvkm_device *, u32 addr, int size);
+void nvkm_mmio_wr(struct nvkm_device *, u32 addr, u32 data, int size);
+int  nvkm_mmio_subdev(int index);
+
+#define nvkm_rd08(d,a) ((u8)nvkm_mmio_rd((d), (a), 1))
+#define nvkm_rd16(d,a) ((u16)nvkm_mmio_rd((d), (a), 2))
+#define nvkm_rd32(d,a) nvkm_mmio_rd((d), (a), 4)
+#define nvkm_wr08(d,a,v) nvkm_mmio_wr((d), (a), (v), 1)
+#define nvkm_wr16(d,a,v) nvkm_mmio_wr((d), (a), (v), 2)
+#define nvkm_wr32(d,a,v) nvkm_mmio_wr((d), (a), (v), 4)
+#else
 #define nvkm_rd08(d,a) ioread8((d)->pri + (a))
 #define nvkm_rd16(d,a) ioread16_native((d)->pri + (a))
 #define nvkm_rd32(d,a) ioread32_native((d)->pri + (a))
 #define nvkm_wr08(d,a,v) iowrite8((v), (d)->pri + (a))
 #define nvkm_wr16(d,a,v) iowrite16_native((v), (d)->pri + (a))
 #define nvkm_wr32(d,a,v) iowrite32_native((v), (d)->pri + (a))
+
+static inline int
+nvkm_mmio_subdev(int index)
+{
+	return index;
+}
+#endif
 #define nvkm_mask(d,a,m,v) ({                                                  \
 	struct nvkm_device *_device = (d);                                     \
 	u32 _addr = (a), _temp = nvkm_rd32(_device, _addr);                    \
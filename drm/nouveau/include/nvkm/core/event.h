@@ -12,7 +12,7 @@ struct nvkm_event {
 
 	spinlock_t refs_lock;
 	spinlock_t list_lock;
-	struct list_head list;
+	struct list_head *list;
 	int *refs;
 };
 
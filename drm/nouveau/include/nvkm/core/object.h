@@ -5,6 +5,7 @@
 struct nvkm_event;
 struct nvkm_gpuobj;
 struct nvkm_oclass;
+struct nvkm_object_sclass;
 
 struct nvkm_object {
 	const struct nvkm_object_func *func;
@@ -19,6 +20,8 @@ struct nvkm_object {
 	u64 token;
 	u64 object;
 	struct rb_node node;
+
+	struct nvkm_object_sclass *sclass;
 };
 
 struct nvkm_object_func {
@@ -61,6 +64,8 @@ int nvkm_object_wr16(struct nvkm_object *, u64 addr, u16  data);
 int nvkm_object_wr32(struct nvkm_object *, u64 addr, u32  data);
 int nvkm_object_bind(struct nvkm_object *, struct nvkm_gpuobj *, int align,
 		     struct nvkm_gpuobj **);
+int nvkm_object_sclass(struct nvkm_object *, s32 oclass);
+void nvkm_object_sclass_fini(struct nvkm_object *);
 
 struct nvkm_sclass {
 	int minver;
@@ -157,7 +157,7 @@ static void
 nouveau_accel_init(struct nouveau_drm *drm)
 {
 	struct nvif_device *device = &drm->device;
-	struct nvif_sclass *sclass;
+	const struct nvif_sclass *sclass;
 	u32 arg0, arg1;
 	int ret, i, n;
 
@@ -168,7 +168,7 @@ nouveau_accel_init(struct nouveau_drm *drm)
 	/*XXX: this is crap, but the fence/channel stuff is a little
 	 *     backwards in some places.  this will be fixed.
 	 */
-	ret = n = nvif_object_sclass_get(&device->object, &sclass);
+	ret = n = nvif_object_sclass(&device->object, &sclass);
 	if (ret < 0)
 		return;
 
@@ -200,7 +200,6 @@ nouveau_accel_init(struct nouveau_drm *drm)
 		}
 	}
 
-	nvif_object_sclass_put(&sclass);
 	if (ret) {
 		NV_ERROR(drm, "failed to initialise sync subsystem, %d\n", ret);
 		nouveau_accel_fini(drm);
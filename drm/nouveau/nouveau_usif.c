@@ -318,6 +318,13 @@ usif_ioctl(struct drm_file *filp, void __user *user, u32 argc)
 
 	mutex_lock(&cli->mutex);
 	switch (argv->v0.type) {
+	case NVIF_IOCTL_V0_BATCH:
+		/* records carry their own owner, and NEW/DEL among them would
+		 * bypass object tracking here, clients fall back to sending
+		 * them one at a time
+		 */
+		ret = -EINVAL;
+		break;
 	case NVIF_IOCTL_V0_NEW:
 		/* ... except if we're creating children */
 		argv->v0.owner = NVIF_IOCTL_V0_OWNER_ANY;
@@ -68,12 +68,12 @@ nv50_chan_create(struct nvif_device *device, struct nvif_object *disp,
 		 const s32 *oclass, u8 head, void *data, u32 size,
 		 struct nv50_chan *chan)
 {
-	struct nvif_sclass *sclass;
+	const struct nvif_sclass *sclass;
 	int ret, i, n;
 
 	chan->device = device;
 
-	ret = n = nvif_object_sclass_get(disp, &sclass);
+	ret = n = nvif_object_sclass(disp, &sclass);
 	if (ret < 0)
 		return ret;
 
@@ -84,14 +84,12 @@ nv50_chan_create(struct nvif_device *device, struct nvif_object *disp,
 						       data, size, &chan->user);
 				if (ret == 0)
 					nvif_object_map(&chan->user);
-				nvif_object_sclass_put(&sclass);
 				return ret;
 			}
 		}
 		oclass++;
 	}
 
-	nvif_object_sclass_put(&sclass);
 	return -ENOSYS;
 }
 
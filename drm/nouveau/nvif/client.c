@@ -61,6 +61,7 @@ nvif_drivers[] = {
 	&nvif_driver_nvkm,
 #else
 	&nvif_driver_drm,
+	&nvif_driver_shm,
 	&nvif_driver_lib,
 	&nvif_driver_null,
 #endif
@@ -172,7 +172,13 @@ nvif_notify_init(struct nvif_object *object, int (*func)(struct nvif_notify *),
 		struct nvif_ioctl_v0 ioctl;
 		struct nvif_ioctl_ntfy_new_v0 ntfy;
 		struct nvif_notify_req_v0 req;
-	} *args;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_NTFY_NEW,
+		.ntfy.event = event,
+		.req.reply = reply,
+		.req.token = (unsigned long)(void *)notify,
+	};
+	struct nvif_ioctlv iov = { data, size };
 	int ret = -ENOMEM;
 
 	notify->object = object;
@@ -189,21 +195,8 @@ nvif_notify_init(struct nvif_object *object, int (*func)(struct nvif_notify *),
 			goto done;
 	}
 
-	if (!(args = kmalloc(sizeof(*args) + size, GFP_KERNEL)))
-		goto done;
-	args->ioctl.version = 0;
-	args->ioctl.type = NVIF_IOCTL_V0_NTFY_NEW;
-	args->ntfy.version = 0;
-	args->ntfy.event = event;
-	args->req.version = 0;
-	args->req.reply = notify->size;
-	args->req.route = 0;
-	args->req.token = (unsigned long)(void *)notify;
-
-	memcpy(args->req.data, data, size);
-	ret = nvif_object_ioctl(object, args, sizeof(*args) + size, NULL);
-	notify->index = args->ntfy.index;
-	kfree(args);
+	ret = nvif_object_ioctlv(object, &args, sizeof(args), &iov, 1, NULL);
+	notify->index = args.ntfy.index;
 done:
 	if (ret)
 		nvif_notify_fini(notify);
@@ -48,6 +48,41 @@ nvif_object_ioctl(struct nvif_object *object, void *data, u32 size, void **hack)
 				     data, size, hack);
 }
 
+/* assembles an ioctl from its header and a list of argument fragments, on
+ * the stack unless they're too large to fit, and scatters the reply back
+ * over the header and fragments once it's been executed
+ */
+int
+nvif_object_ioctlv(struct nvif_object *object, void *head, u32 hsize,
+		   const struct nvif_ioctlv *iov, int nr, void **hack)
+{
+	u8 stack[256], *data = stack, *ptr;
+	u32 size = hsize;
+	int ret, i;
+
+	for (i = 0; i < nr; i++)
+		size += iov[i].size;
+
+	if (size > sizeof(stack)) {
+		if (!(data = kmalloc(size, GFP_KERNEL)))
+			return -ENOMEM;
+	}
+
+	memcpy(data, head, hsize);
+	for (ptr = data + hsize, i = 0; i < nr; ptr += iov[i++].size)
+		memcpy(ptr, iov[i].data, iov[i].size);
+
+	ret = nvif_object_ioctl(object, data, size, hack);
+
+	memcpy(head, data, hsize);
+	for (ptr = data + hsize, i = 0; i < nr; ptr += iov[i++].size)
+		memcpy(iov[i].data, ptr, iov[i].size);
+
+	if (data != stack)
+		kfree(data);
+	return ret;
+}
+
 void
 nvif_object_sclass_put(struct nvif_sclass **psclass)
 {
@@ -55,20 +90,29 @@ nvif_object_sclass_put(struct nvif_sclass **psclass)
 	*psclass = NULL;
 }
 
-int
-nvif_object_sclass_get(struct nvif_object *object, struct nvif_sclass **psclass)
+/* the class list of an object doesn't change over its lifetime, so it's
+ * only queried once and cached, the query is done on the stack and only
+ * falls back to the heap for objects with unusually many classes
+ */
+static int
+nvif_object_sclass_query(struct nvif_object *object)
 {
 	struct {
 		struct nvif_ioctl_v0 ioctl;
 		struct nvif_ioctl_sclass_v0 sclass;
-	} *args = NULL;
-	int ret, cnt = 0, i;
+	} *args;
+	u8 stack[sizeof(*args) + 32 * sizeof(args->sclass.oclass[0])];
+	int ret, cnt = 32, i;
 	u32 size;
 
 	while (1) {
 		size = sizeof(*args) + cnt * sizeof(args->sclass.oclass[0]);
-		if (!(args = kmalloc(size, GFP_KERNEL)))
-			return -ENOMEM;
+		if (size > sizeof(stack)) {
+			if (!(args = kmalloc(size, GFP_KERNEL)))
+				return -ENOMEM;
+		} else {
+			args = (void *)stack;
+		}
 		args->ioctl.version = 0;
 		args->ioctl.type = NVIF_IOCTL_V0_SCLASS;
 		args->sclass.version = 0;
@@ -78,27 +122,65 @@ nvif_object_sclass_get(struct nvif_object *object, struct nvif_sclass **psclass)
 		if (ret == 0 && args->sclass.count <= cnt)
 			break;
 		cnt = args->sclass.count;
-		kfree(args);
+		if (args != (void *)stack)
+			kfree(args);
 		if (ret != 0)
 			return ret;
 	}
 
-	*psclass = kzalloc(sizeof(**psclass) * args->sclass.count, GFP_KERNEL);
-	if (*psclass) {
+	object->sclass.data = kcalloc(max_t(int, args->sclass.count, 1),
+				      sizeof(*object->sclass.data), GFP_KERNEL);
+	if (object->sclass.data) {
+		struct nvif_sclass *sclass = object->sclass.data;
 		for (i = 0; i < args->sclass.count; i++) {
-			(*psclass)[i].oclass = args->sclass.oclass[i].oclass;
-			(*psclass)[i].minver = args->sclass.oclass[i].minver;
-			(*psclass)[i].maxver = args->sclass.oclass[i].maxver;
+			sclass[i].oclass = args->sclass.oclass[i].oclass;
+			sclass[i].minver = args->sclass.oclass[i].minver;
+			sclass[i].maxver = args->sclass.oclass[i].maxver;
 		}
-		ret = args->sclass.count;
+		object->sclass.count = args->sclass.count;
+		ret = 0;
 	} else {
 		ret = -ENOMEM;
 	}
 
-	kfree(args);
+	if (args != (void *)stack)
+		kfree(args);
 	return ret;
 }
 
+/* returns the object's cached class list, which remains valid for as long
+ * as the object does, and must not be freed by the caller
+ */
+int
+nvif_object_sclass(struct nvif_object *object,
+		   const struct nvif_sclass **psclass)
+{
+	int ret;
+
+	if (!object->sclass.data) {
+		if ((ret = nvif_object_sclass_query(object)))
+			return ret;
+	}
+
+	*psclass = object->sclass.data;
+	return object->sclass.count;
+}
+
+int
+nvif_object_sclass_get(struct nvif_object *object, struct nvif_sclass **psclass)
+{
+	const struct nvif_sclass *sclass;
+	int count;
+
+	if ((count = nvif_object_sclass(object, &sclass)) < 0)
+		return count;
+
+	*psclass = kmemdup(sclass, count * sizeof(**psclass), GFP_KERNEL);
+	if (!*psclass && count)
+		return -ENOMEM;
+	return count;
+}
+
 u32
 nvif_object_rd(struct nvif_object *object, int size, u64 addr)
 {
@@ -136,32 +218,374 @@ nvif_object_wr(struct nvif_object *object, int size, u64 addr, u32 data)
 	}
 }
 
+static int
+nvif_object_rwv_rd(struct nvif_object *object, u8 size, u64 addr, u32 *data)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_rd_v0 rd;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_RD,
+		.rd.size = size,
+		.rd.addr = addr,
+	};
+	int ret;
+
+	if (object->map.ptr) {
+		u8 __iomem *ptr = (u8 __iomem *)object->map.ptr + addr;
+		switch (size) {
+		case 1: *data = ioread8(ptr); return 0;
+		case 2: *data = ioread16_native(ptr); return 0;
+		case 4: *data = ioread32_native(ptr); return 0;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	ret = nvif_object_ioctl(object, &args, sizeof(args), NULL);
+	*data = args.rd.data;
+	return ret;
+}
+
+static int
+nvif_object_rwv_wr(struct nvif_object *object, u8 size, u64 addr, u32 data)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_wr_v0 wr;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_WR,
+		.wr.size = size,
+		.wr.addr = addr,
+		.wr.data = data,
+	};
+
+	if (object->map.ptr) {
+		u8 __iomem *ptr = (u8 __iomem *)object->map.ptr + addr;
+		switch (size) {
+		case 1: iowrite8(data, ptr); return 0;
+		case 2: iowrite16_native(data, ptr); return 0;
+		case 4: iowrite32_native(data, ptr); return 0;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	return nvif_object_ioctl(object, &args, sizeof(args), NULL);
+}
+
+/* performs a single access of a vector, used when the object is mapped, or
+ * the other end doesn't implement the vectored ioctls
+ */
+static int
+nvif_object_rwv_op(struct nvif_object *object, u8 type,
+		   struct nvif_object_rwv *op)
+{
+	u32 full, data;
+	int ret;
+
+	if (op->size != 1 && op->size != 2 && op->size != 4)
+		return -EINVAL;
+	full = 0xffffffff >> (32 - op->size * 8);
+
+	if (type == NVIF_IOCTL_V0_RDV) {
+		ret = nvif_object_rwv_rd(object, op->size, op->addr, &data);
+		op->data = data & op->mask;
+		return ret;
+	}
+
+	data = op->data;
+	if ((op->mask & full) != full) {
+		ret = nvif_object_rwv_rd(object, op->size, op->addr, &data);
+		if (ret)
+			return ret;
+		data = (data & ~op->mask) | (op->data & op->mask);
+	}
+
+	return nvif_object_rwv_wr(object, op->size, op->addr, data);
+}
+
+/* submits part of a vector of register accesses as a single ioctl, the
+ * return value is that of the ioctl, each access' status is returned in
+ * the access itself
+ */
+static int
+nvif_object_rwv_ioctl(struct nvif_object *object, u8 type,
+		      struct nvif_object_rwv *op, u32 count)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_rwv_v0 rwv;
+	} *args;
+	u32 size = sizeof(*args) + count * sizeof(args->rwv.op[0]);
+	int ret, i;
+
+	if (!(args = kmalloc(size, GFP_KERNEL)))
+		return -ENOMEM;
+	args->ioctl.version = 0;
+	args->ioctl.type = type;
+	args->rwv.version = 0;
+	args->rwv.count = count;
+	for (i = 0; i < count; i++) {
+		args->rwv.op[i].size = op[i].size;
+		args->rwv.op[i].addr = op[i].addr;
+		args->rwv.op[i].mask = op[i].mask;
+		args->rwv.op[i].data = op[i].data;
+	}
+
+	ret = nvif_object_ioctl(object, args, size, NULL);
+	if (ret == 0) {
+		for (i = 0; i < count; i++) {
+			op[i].status = args->rwv.op[i].status;
+			if (type == NVIF_IOCTL_V0_RDV)
+				op[i].data = args->rwv.op[i].data;
+		}
+	}
+
+	kfree(args);
+	return ret;
+}
+
+/* submits a vector of register accesses in as few ioctls as the driver
+ * allows, or performs them directly if the object is mapped.  the return
+ * value is the first failing access' status, each access' status is also
+ * returned individually.
+ *
+ * -EINVAL for a whole chunk means the ioctl itself is unknown (an older
+ * kernel), and -E2BIG that the driver couldn't take it after all, the
+ * remaining accesses are then submitted one at a time.
+ */
+static int
+nvif_object_rwv(struct nvif_object *object, u8 type,
+		struct nvif_object_rwv *op, u32 count)
+{
+	const struct nvif_driver *driver = object->client->driver;
+	const u32 head = sizeof(struct nvif_ioctl_v0) +
+			 sizeof(struct nvif_ioctl_rwv_v0);
+	const u32 each = sizeof(struct nvif_ioctl_rwv_op_v0);
+	u32 max = count, done = 0, i;
+	int ret;
+
+	if (object->map.ptr)
+		goto fallback;
+
+	if (driver->ioctl_max) {
+		if (driver->ioctl_max < head + each)
+			goto fallback;
+		max = (driver->ioctl_max - head) / each;
+	}
+
+	while (done < count) {
+		u32 nr = min(count - done, max);
+		ret = nvif_object_rwv_ioctl(object, type, &op[done], nr);
+		if (ret) {
+			if (ret == -EINVAL || ret == -E2BIG)
+				break;
+			for (i = done; i < count; i++)
+				op[i].status = ret;
+			goto done;
+		}
+		done += nr;
+	}
+
+fallback:
+	for (i = done; i < count; i++)
+		op[i].status = nvif_object_rwv_op(object, type, &op[i]);
+
+done:
+	for (ret = 0, i = 0; i < count && !ret; i++)
+		ret = op[i].status;
+	return ret;
+}
+
+int
+nvif_object_rdv(struct nvif_object *object, struct nvif_object_rwv *op,
+		u32 count)
+{
+	return nvif_object_rwv(object, NVIF_IOCTL_V0_RDV, op, count);
+}
+
+int
+nvif_object_wrv(struct nvif_object *object, struct nvif_object_rwv *op,
+		u32 count)
+{
+	return nvif_object_rwv(object, NVIF_IOCTL_V0_WRV, op, count);
+}
+
 int
 nvif_object_mthd(struct nvif_object *object, u32 mthd, void *data, u32 size)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_mthd_v0 mthd;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_MTHD,
+		.mthd.method = mthd,
+	};
+	struct nvif_ioctlv iov = { data, size };
+	return nvif_object_ioctlv(object, &args, sizeof(args), &iov, 1, NULL);
+}
+
+void
+nvif_batch_fini(struct nvif_batch *batch)
+{
+	kfree(batch->data);
+	kfree(batch->rec);
+	batch->data = NULL;
+	batch->rec = NULL;
+}
+
+void
+nvif_batch_init(struct nvif_batch *batch, struct nvif_client *client)
+{
+	batch->client = client;
+	batch->data = NULL;
+	batch->limit = 0;
+	batch->rec = NULL;
+	batch->slots = 0;
+	batch->count = 0;
+	batch->size = sizeof(struct nvif_ioctl_v0) +
+		      sizeof(struct nvif_ioctl_batch_v0);
+	batch->ret = 0;
+}
+
+/* reserves space for a record of the given size, and returns a pointer to
+ * its nvif_ioctl_v0 header
+ */
+static void *
+nvif_batch_add(struct nvif_batch *batch, u32 size, void *data, u32 dsize,
+	       u32 skip, int *ret)
+{
+	struct nvif_ioctl_batch_rec_v0 *rec;
+	struct nvif_ioctl_v0 *ioctl;
+	u32 need = batch->size + ALIGN(sizeof(*rec) + size, 8);
+
+	if (batch->ret)
+		return NULL;
+
+	if (need > batch->limit) {
+		u32 limit = max_t(u32, need, batch->limit * 2);
+		u8 *temp = krealloc(batch->data, limit, GFP_KERNEL);
+		if (!temp)
+			goto fail;
+		batch->data = temp;
+		batch->limit = limit;
+	}
+
+	if (batch->count == batch->slots) {
+		u32 slots = max_t(u32, 16, batch->slots * 2);
+		void *temp = krealloc(batch->rec, slots * sizeof(*batch->rec),
+				      GFP_KERNEL);
+		if (!temp)
+			goto fail;
+		batch->rec = temp;
+		batch->slots = slots;
+	}
+
+	batch->rec[batch->count].data = data;
+	batch->rec[batch->count].size = dsize;
+	batch->rec[batch->count].skip = skip;
+	batch->rec[batch->count].ret  = ret;
+	batch->count++;
+
+	rec = (void *)(batch->data + batch->size);
+	memset(rec, 0x00, need - batch->size);
+	rec->size = size;
+	batch->size = need;
+
+	ioctl = (void *)rec->data;
+	return ioctl;
+
+fail:
+	batch->ret = -ENOMEM;
+	return NULL;
+}
+
+void
+nvif_batch_ioctl(struct nvif_batch *batch, struct nvif_object *object,
+		 void *data, u32 size, int *ret)
+{
+	struct nvif_ioctl_v0 *ioctl;
+
+	if ((ioctl = nvif_batch_add(batch, size, data, size, 0, ret))) {
+		memcpy(ioctl, data, size);
+		if (object != &batch->client->object)
+			ioctl->object = nvif_handle(object);
+		else
+			ioctl->object = 0;
+		ioctl->owner = NVIF_IOCTL_V0_OWNER_ANY;
+	}
+}
+
+void
+nvif_batch_mthd(struct nvif_batch *batch, struct nvif_object *object,
+		u32 mthd, void *data, u32 size, int *ret)
 {
 	struct {
 		struct nvif_ioctl_v0 ioctl;
 		struct nvif_ioctl_mthd_v0 mthd;
 	} *args;
-	u8 stack[128];
-	int ret;
 
-	if (sizeof(*args) + size > sizeof(stack)) {
-		if (!(args = kmalloc(sizeof(*args) + size, GFP_KERNEL)))
-			return -ENOMEM;
-	} else {
-		args = (void *)stack;
+	args = nvif_batch_add(batch, sizeof(*args) + size, data, size,
+			      sizeof(*args), ret);
+	if (args) {
+		args->ioctl.type = NVIF_IOCTL_V0_MTHD;
+		if (object != &batch->client->object)
+			args->ioctl.object = nvif_handle(object);
+		args->ioctl.owner = NVIF_IOCTL_V0_OWNER_ANY;
+		args->mthd.method = mthd;
+		memcpy(args->mthd.data, data, size);
 	}
-	args->ioctl.version = 0;
-	args->ioctl.type = NVIF_IOCTL_V0_MTHD;
-	args->mthd.version = 0;
-	args->mthd.method = mthd;
+}
 
-	memcpy(args->mthd.data, data, size);
-	ret = nvif_object_ioctl(object, args, sizeof(*args) + size, NULL);
-	memcpy(data, args->mthd.data, size);
-	if (args != (void *)stack)
-		kfree(args);
+int
+nvif_batch_exec(struct nvif_batch *batch)
+{
+	struct nvif_client *client = batch->client;
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_batch_v0 batch;
+	} *args = (void *)batch->data;
+	struct nvif_ioctl_batch_rec_v0 *rec;
+	u32 next, i;
+	int ret = batch->ret;
+
+	if (ret || !batch->count)
+		goto done;
+
+	memset(args, 0x00, sizeof(*args));
+	args->ioctl.type = NVIF_IOCTL_V0_BATCH;
+	args->batch.count = batch->count;
+
+	/* the container is validated as a whole before any record in it is
+	 * executed, so a failure here means nothing has run yet.  the other
+	 * end either doesn't support batching, or won't accept it from us
+	 * (usif), so the records are submitted one-by-one instead
+	 */
+	ret = nvif_object_ioctl(&client->object, args, batch->size, NULL);
+
+	for (i = 0, next = sizeof(*args); i < batch->count; i++) {
+		struct nvif_batch_rec *out = &batch->rec[i];
+		rec = (void *)(batch->data + next);
+
+		if (ret) {
+			rec->ret = client->driver->ioctl(client->object.priv,
+							 client->super,
+							 rec->data, rec->size,
+							 NULL);
+		}
+
+		memcpy(out->data, rec->data + out->skip, out->size);
+		if (out->ret)
+			*out->ret = rec->ret;
+		next += ALIGN(sizeof(*rec) + rec->size, 8);
+	}
+	ret = 0;
+
+done:
+	batch->size = sizeof(*args);
+	batch->count = 0;
+	batch->ret = 0;
 	return ret;
 }
 
@@ -220,6 +644,9 @@ nvif_object_fini(struct nvif_object *object)
 		.ioctl.type = NVIF_IOCTL_V0_DEL,
 	};
 
+	kfree(object->sclass.data);
+	object->sclass.data = NULL;
+
 	if (!object->client)
 		return;
 
@@ -235,7 +662,14 @@ nvif_object_init(struct nvif_object *parent, u32 handle, s32 oclass,
 	struct {
 		struct nvif_ioctl_v0 ioctl;
 		struct nvif_ioctl_new_v0 new;
-	} *args;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_NEW,
+		.new.token = nvif_handle(object),
+		.new.object = nvif_handle(object),
+		.new.handle = handle,
+		.new.oclass = oclass,
+	};
+	struct nvif_ioctlv iov = { data, size };
 	int ret = 0;
 
 	object->client = NULL;
@@ -243,27 +677,13 @@ nvif_object_init(struct nvif_object *parent, u32 handle, s32 oclass,
 	object->oclass = oclass;
 	object->map.ptr = NULL;
 	object->map.size = 0;
+	object->sclass.data = NULL;
+	object->sclass.count = 0;
 
 	if (parent) {
-		if (!(args = kmalloc(sizeof(*args) + size, GFP_KERNEL))) {
-			nvif_object_fini(object);
-			return -ENOMEM;
-		}
-
-		args->ioctl.version = 0;
-		args->ioctl.type = NVIF_IOCTL_V0_NEW;
-		args->new.version = 0;
-		args->new.route = parent->client->route;
-		args->new.token = nvif_handle(object);
-		args->new.object = nvif_handle(object);
-		args->new.handle = handle;
-		args->new.oclass = oclass;
-
-		memcpy(args->new.data, data, size);
-		ret = nvif_object_ioctl(parent, args, sizeof(*args) + size,
-					&object->priv);
-		memcpy(data, args->new.data, size);
-		kfree(args);
+		args.new.route = parent->client->route;
+		ret = nvif_object_ioctlv(parent, &args, sizeof(args), &iov, 1,
+					 &object->priv);
 		if (ret == 0)
 			object->client = parent->client;
 	}
@@ -33,6 +33,8 @@
 struct nvkm_client_notify {
 	struct nvkm_client *client;
 	struct nvkm_notify n;
+	u32 serial;
+	u8 index;
 	u8 version;
 	u8 size;
 	union {
@@ -40,18 +42,255 @@ struct nvkm_client_notify {
 	} rep;
 };
 
+/* the ntfy ioctls carry an 8-bit index */
+#define NVKM_CLIENT_NOTIFY_MAX 256
+
+/* notify replies can be queued on a per-client ring instead of being
+ * delivered from the context of the event source.  producers claim a
+ * slot with a cmpxchg on the head and publish it through the slot's
+ * sequence number, so sending never blocks, and a full ring drops the
+ * reply rather than waiting for the consumer to catch up.  there's a
+ * single consumer, which drains the ring in batches.
+ */
+struct nvkm_client_ring_rep {
+	u32 seq;
+	u32 serial;
+	u8  index;
+	u8  length;
+	u16 size;
+	u8  data[sizeof(struct nvif_notify_rep_v0) + 256];
+};
+
+struct nvkm_client_ring {
+	u32 mask;
+	u32 head;
+	u32 tail;
+	bool sleep;
+	bool kick;
+	atomic_t lost;
+	wait_queue_head_t wait;
+	u32 busy;
+	atomic_t flush;
+	wait_queue_head_t idle;
+	struct nvkm_client_ring_rep rep[];
+};
+
+static inline bool
+nvkm_client_ring_empty(struct nvkm_client_ring *ring)
+{
+	struct nvkm_client_ring_rep *rep = &ring->rep[ring->tail & ring->mask];
+	return smp_load_acquire(&rep->seq) != ring->tail + 1;
+}
+
+static int
+nvkm_client_ring_push(struct nvkm_client_ring *ring,
+		      struct nvkm_client_notify *notify,
+		      const void *data, u32 size)
+{
+	struct nvkm_client_ring_rep *rep;
+	u32 head = READ_ONCE(ring->head), prev, seq;
+
+	if (WARN_ON(notify->size + size > sizeof(rep->data)))
+		return NVKM_NOTIFY_KEEP;
+
+	for (;;) {
+		rep = &ring->rep[head & ring->mask];
+		seq = smp_load_acquire(&rep->seq);
+		if (seq == head) {
+			prev = cmpxchg(&ring->head, head, head + 1);
+			if (prev == head)
+				break;
+			head = prev;
+		} else
+		if ((s32)(seq - head) < 0) {
+			atomic_inc(&ring->lost);
+			return NVKM_NOTIFY_KEEP;
+		} else {
+			head = READ_ONCE(ring->head);
+		}
+	}
+
+	rep->serial = notify->serial;
+	rep->index = notify->index;
+	rep->length = notify->size;
+	rep->size = size;
+	memcpy(rep->data, &notify->rep, notify->size);
+	memcpy(rep->data + notify->size, data, size);
+	smp_store_release(&rep->seq, head + 1);
+
+	/* pairs with the barrier in nvkm_client_ring_wait() */
+	smp_mb();
+	if (READ_ONCE(ring->sleep))
+		wake_up(&ring->wait);
+	return NVKM_NOTIFY_KEEP;
+}
+
+void
+nvkm_client_ring_kick(struct nvkm_client *client)
+{
+	struct nvkm_client_ring *ring = client->ring;
+	if (ring) {
+		WRITE_ONCE(ring->kick, true);
+		wake_up(&ring->wait);
+	}
+}
+
+bool
+nvkm_client_ring_wait(struct nvkm_client *client, long timeout)
+{
+	struct nvkm_client_ring *ring = client->ring;
+
+	if (!ring)
+		return false;
+
+	WRITE_ONCE(ring->sleep, true);
+	smp_mb();
+	wait_event_timeout(ring->wait, !nvkm_client_ring_empty(ring) ||
+				       READ_ONCE(ring->kick), timeout);
+	WRITE_ONCE(ring->sleep, false);
+	WRITE_ONCE(ring->kick, false);
+	return !nvkm_client_ring_empty(ring);
+}
+
+static struct nvkm_client_notify *
+nvkm_client_notify_find(struct nvkm_client *client, int index, u32 serial)
+{
+	struct nvkm_client_notify *notify = NULL;
+	if (index >= 0 && index < client->notify_nr) {
+		notify = client->notify[index];
+		if (notify && notify->serial != serial)
+			notify = NULL;
+	}
+	return notify;
+}
+
+/* must not be called with the client's mutex held, replies are passed to
+ * the client's ntfy() without it so that it's free to make ioctl calls, and
+ * a reply that it returns NVKM_NOTIFY_DROP for disarms the notifier as it
+ * would have done had the reply been delivered synchronously.  the reply
+ * being delivered is marked busy while the notifier is known to be live,
+ * see nvkm_client_ring_flush().
+ */
+int
+nvkm_client_ring_drain(struct nvkm_client *client, int budget)
+{
+	struct nvkm_client_ring *ring = client->ring;
+	struct nvkm_client_notify *notify;
+	struct nvkm_client_ring_rep *rep;
+	int count = 0, lost, ret;
+
+	if (!ring)
+		return -ENODEV;
+
+	if ((lost = atomic_xchg(&ring->lost, 0)))
+		nvif_debug(&client->object, "notify ring full, %d lost\n", lost);
+
+	while (count < budget && !nvkm_client_ring_empty(ring)) {
+		rep = &ring->rep[ring->tail & ring->mask];
+
+		/* skip replies for notifiers that have been disarmed, or
+		 * deleted and their index reused, since they were queued
+		 */
+		mutex_lock(&client->mutex);
+		notify = nvkm_client_notify_find(client, rep->index,
+						 rep->serial);
+		if (notify && !test_bit(NVKM_NOTIFY_USER, &notify->n.flags))
+			notify = NULL;
+		if (notify)
+			WRITE_ONCE(ring->busy, ring->busy + 1);
+		mutex_unlock(&client->mutex);
+
+		if (notify) {
+			ret = client->ntfy(rep->data, rep->length,
+					   rep->data + rep->length, rep->size);
+			if (ret == NVKM_NOTIFY_DROP) {
+				mutex_lock(&client->mutex);
+				notify = nvkm_client_notify_find(client,
+								 rep->index,
+								 rep->serial);
+				if (notify)
+					nvkm_notify_put(&notify->n);
+				mutex_unlock(&client->mutex);
+			}
+
+			/* pairs with the barrier in nvkm_client_ring_flush() */
+			smp_store_release(&ring->busy, ring->busy + 1);
+			smp_mb();
+			if (atomic_read(&ring->flush))
+				wake_up(&ring->idle);
+			count++;
+		}
+
+		smp_store_release(&rep->seq, ring->tail + ring->mask + 1);
+		ring->tail++;
+	}
+
+	return count;
+}
+
+/* waits for any reply the consumer is passing to ntfy() to be done with,
+ * so that once a notifier has been disarmed or deleted, the token it was
+ * created with can be freed, as flush_work() does for the work path.  it's
+ * for the caller of NTFY_PUT/NTFY_DEL to do after the ioctl has returned,
+ * and must not be called from ntfy() itself, or with the client's mutex
+ * held.
+ */
+void
+nvkm_client_ring_flush(struct nvkm_client *client)
+{
+	struct nvkm_client_ring *ring = client->ring;
+	u32 busy;
+
+	if (!ring || !((busy = smp_load_acquire(&ring->busy)) & 1))
+		return;
+
+	atomic_inc(&ring->flush);
+	smp_mb();
+	wait_event(ring->idle, READ_ONCE(ring->busy) != busy);
+	atomic_dec(&ring->flush);
+}
+
+int
+nvkm_client_ring_new(struct nvkm_client *client, int order)
+{
+	struct nvkm_client_ring *ring;
+	u32 i;
+
+	if (order < 1 || order > 16)
+		return -EINVAL;
+	if (client->ring || client->notify_nr)
+		return -EBUSY;
+
+	ring = vzalloc(sizeof(*ring) + (sizeof(ring->rep[0]) << order));
+	if (!ring)
+		return -ENOMEM;
+
+	ring->mask = (1 << order) - 1;
+	for (i = 0; i <= ring->mask; i++)
+		ring->rep[i].seq = i;
+	atomic_set(&ring->lost, 0);
+	init_waitqueue_head(&ring->wait);
+	atomic_set(&ring->flush, 0);
+	init_waitqueue_head(&ring->idle);
+	client->ring = ring;
+	return 0;
+}
+
 static int
 nvkm_client_notify(struct nvkm_notify *n)
 {
 	struct nvkm_client_notify *notify = container_of(n, typeof(*notify), n);
 	struct nvkm_client *client = notify->client;
+	if (client->ring)
+		return nvkm_client_ring_push(client->ring, notify,
+					     n->data, n->size);
 	return client->ntfy(&notify->rep, notify->size, n->data, n->size);
 }
 
 int
 nvkm_client_notify_put(struct nvkm_client *client, int index)
 {
-	if (index < ARRAY_SIZE(client->notify)) {
+	if (index >= 0 && index < client->notify_nr) {
 		if (client->notify[index]) {
 			nvkm_notify_put(&client->notify[index]->n);
 			return 0;
@@ -63,7 +302,7 @@ nvkm_client_notify_put(struct nvkm_client *client, int index)
 int
 nvkm_client_notify_get(struct nvkm_client *client, int index)
 {
-	if (index < ARRAY_SIZE(client->notify)) {
+	if (index >= 0 && index < client->notify_nr) {
 		if (client->notify[index]) {
 			nvkm_notify_get(&client->notify[index]->n);
 			return 0;
@@ -75,7 +314,7 @@ nvkm_client_notify_get(struct nvkm_client *client, int index)
 int
 nvkm_client_notify_del(struct nvkm_client *client, int index)
 {
-	if (index < ARRAY_SIZE(client->notify)) {
+	if (index >= 0 && index < client->notify_nr) {
 		if (client->notify[index]) {
 			nvkm_notify_fini(&client->notify[index]->n);
 			kfree(client->notify[index]);
@@ -86,6 +325,26 @@ nvkm_client_notify_del(struct nvkm_client *client, int index)
 	return -ENOENT;
 }
 
+static int
+nvkm_client_notify_grow(struct nvkm_client *client)
+{
+	struct nvkm_client_notify **notify;
+	int nr = min(max(client->notify_nr * 2, 16), NVKM_CLIENT_NOTIFY_MAX);
+
+	if (nr == client->notify_nr)
+		return -ENOSPC;
+
+	notify = krealloc(client->notify, nr * sizeof(*notify), GFP_KERNEL);
+	if (!notify)
+		return -ENOMEM;
+
+	memset(&notify[client->notify_nr], 0x00,
+	       (nr - client->notify_nr) * sizeof(*notify));
+	client->notify = notify;
+	client->notify_nr = nr;
+	return 0;
+}
+
 int
 nvkm_client_notify_new(struct nvkm_object *object,
 		       struct nvkm_event *event, void *data, u32 size)
@@ -95,16 +354,20 @@ nvkm_client_notify_new(struct nvkm_object *object,
 	union {
 		struct nvif_notify_req_v0 v0;
 	} *req = data;
-	u8  index, reply;
+	int index;
+	u8  reply;
 	int ret;
 
-	for (index = 0; index < ARRAY_SIZE(client->notify); index++) {
+	for (index = 0; index < client->notify_nr; index++) {
 		if (!client->notify[index])
 			break;
 	}
 
-	if (index == ARRAY_SIZE(client->notify))
-		return -ENOSPC;
+	if (index == client->notify_nr) {
+		ret = nvkm_client_notify_grow(client);
+		if (ret)
+			return ret;
+	}
 
 	notify = kzalloc(sizeof(*notify), GFP_KERNEL);
 	if (!notify)
@@ -129,6 +392,8 @@ nvkm_client_notify_new(struct nvkm_object *object,
 		if (ret == 0) {
 			client->notify[index] = notify;
 			notify->client = client;
+			notify->serial = ++client->notify_serial;
+			notify->index = index;
 			return index;
 		}
 	}
@@ -205,11 +470,108 @@ nvkm_client_object_func = {
 	.sclass = nvkm_client_child_get,
 };
 
+/* objects are also kept in an open-addressed hash of their handles, which
+ * is what resolves the handle of every ioctl.  entries are 16 bytes, so
+ * a lookup usually touches a single cache line, and deletion shifts the
+ * rest of the probe sequence back rather than leaving tombstones.
+ *
+ * the tree remains authoritative, if growing the hash ever fails, lookups
+ * that miss in the hash fall back to searching it.
+ */
+static inline u32
+nvkm_client_hash(struct nvkm_client *client, u64 handle)
+{
+	return hash_64(handle, client->objhash.bits);
+}
+
+static void
+nvkm_client_hash_remove(struct nvkm_client *client, struct nvkm_object *object)
+{
+	struct nvkm_client_hash *slot = client->objhash.slot;
+	u32 mask = (1 << client->objhash.bits) - 1, i, j, k;
+
+	if (!slot)
+		return;
+
+	for (i = nvkm_client_hash(client, object->object); slot[i].object;
+	     i = (i + 1) & mask) {
+		if (slot[i].object == object)
+			break;
+	}
+
+	if (!slot[i].object)
+		return;
+
+	for (j = i;;) {
+		slot[i].object = NULL;
+		do {
+			j = (j + 1) & mask;
+			if (!slot[j].object) {
+				client->objhash.count--;
+				return;
+			}
+			k = nvkm_client_hash(client, slot[j].handle);
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		slot[i] = slot[j];
+		i = j;
+	}
+}
+
+static void
+nvkm_client_hash_add(struct nvkm_client_hash *slot, u32 bits,
+		     struct nvkm_object *object)
+{
+	u32 mask = (1 << bits) - 1, i;
+	for (i = hash_64(object->object, bits); slot[i].object;
+	     i = (i + 1) & mask) {
+	}
+	slot[i].handle = object->object;
+	slot[i].object = object;
+}
+
+static int
+nvkm_client_hash_grow(struct nvkm_client *client)
+{
+	struct nvkm_client_hash *slot = client->objhash.slot, *temp;
+	u32 bits = client->objhash.bits ? client->objhash.bits + 1 : 4, i;
+
+	if (!(temp = kcalloc(1 << bits, sizeof(*temp), GFP_KERNEL)))
+		return -ENOMEM;
+
+	for (i = 0; slot && i < (1 << client->objhash.bits); i++) {
+		if (slot[i].object)
+			nvkm_client_hash_add(temp, bits, slot[i].object);
+	}
+
+	kfree(slot);
+	client->objhash.slot = temp;
+	client->objhash.bits = bits;
+	return 0;
+}
+
+static void
+nvkm_client_hash_insert(struct nvkm_client *client, struct nvkm_object *object)
+{
+	/* kept at most half full, so probe sequences stay short */
+	if ((client->objhash.count + 1) * 2 > (1 << client->objhash.bits)) {
+		if (nvkm_client_hash_grow(client)) {
+			client->objhash.partial = true;
+			return;
+		}
+	}
+
+	nvkm_client_hash_add(client->objhash.slot, client->objhash.bits,
+			     object);
+	client->objhash.count++;
+}
+
 void
 nvkm_client_remove(struct nvkm_client *client, struct nvkm_object *object)
 {
-	if (!RB_EMPTY_NODE(&object->node))
+	if (!RB_EMPTY_NODE(&object->node)) {
+		nvkm_client_hash_remove(client, object);
 		rb_erase(&object->node, &client->objroot);
+	}
 }
 
 bool
@@ -233,13 +595,27 @@ nvkm_client_insert(struct nvkm_client *client, struct nvkm_object *object)
 
 	rb_link_node(&object->node, parent, ptr);
 	rb_insert_color(&object->node, &client->objroot);
+	nvkm_client_hash_insert(client, object);
 	return true;
 }
 
 struct nvkm_object *
 nvkm_client_search(struct nvkm_client *client, u64 handle)
 {
+	struct nvkm_client_hash *slot = client->objhash.slot;
 	struct rb_node *node = client->objroot.rb_node;
+	u32 mask = (1 << client->objhash.bits) - 1, i;
+
+	if (slot) {
+		for (i = nvkm_client_hash(client, handle); slot[i].object;
+		     i = (i + 1) & mask) {
+			if (slot[i].handle == handle)
+				return slot[i].object;
+		}
+		if (!client->objhash.partial)
+			return NULL;
+	}
+
 	while (node) {
 		struct nvkm_object *object =
 			container_of(node, typeof(*object), node);
@@ -261,7 +637,7 @@ nvkm_client_fini(struct nvkm_client *client, bool suspend)
 	const char *name[2] = { "fini", "suspend" };
 	int i;
 	nvif_debug(object, "%s notify\n", name[suspend]);
-	for (i = 0; i < ARRAY_SIZE(client->notify); i++)
+	for (i = 0; i < client->notify_nr; i++)
 		nvkm_client_notify_put(client, i);
 	return nvkm_object_fini(&client->object, suspend);
 }
@@ -279,9 +655,12 @@ nvkm_client_del(struct nvkm_client **pclient)
 	int i;
 	if (client) {
 		nvkm_client_fini(client, false);
-		for (i = 0; i < ARRAY_SIZE(client->notify); i++)
+		for (i = 0; i < client->notify_nr; i++)
 			nvkm_client_notify_del(client, i);
+		kfree(client->notify);
+		vfree(client->ring);
 		nvkm_object_dtor(&client->object);
+		kfree(client->objhash.slot);
 		kfree(*pclient);
 		*pclient = NULL;
 	}
@@ -299,6 +678,7 @@ nvkm_client_new(const char *name, u64 device, const char *cfg,
 	oclass.client = client;
 
 	nvkm_object_ctor(&nvkm_client_object_func, &oclass, &client->object);
+	mutex_init(&client->mutex);
 	snprintf(client->name, sizeof(client->name), "%s", name);
 	client->device = device;
 	client->debug = nvkm_dbgopt(dbg, "CLIENT");
@@ -48,19 +48,22 @@ nvkm_event_get(struct nvkm_event *event, u32 types, int index)
 	}
 }
 
+/* notifiers are kept on a list per index, which senders walk under rcu
+ * rather than list_lock, so only interested notifiers are visited and
+ * concurrent senders don't serialise on each other
+ */
 void
 nvkm_event_send(struct nvkm_event *event, u32 types, int index,
 		void *data, u32 size)
 {
 	struct nvkm_notify *notify;
-	unsigned long flags;
 
 	if (!event->refs || WARN_ON(index >= event->index_nr))
 		return;
 
-	spin_lock_irqsave(&event->list_lock, flags);
-	list_for_each_entry(notify, &event->list, head) {
-		if (notify->index == index && (notify->types & types)) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(notify, &event->list[index], head) {
+		if (notify->types & types) {
 			if (event->func->send) {
 				event->func->send(data, size, notify);
 				continue;
@@ -68,13 +71,14 @@ nvkm_event_send(struct nvkm_event *event, u32 types, int index,
 			nvkm_notify_send(notify, data, size);
 		}
 	}
-	spin_unlock_irqrestore(&event->list_lock, flags);
+	rcu_read_unlock();
 }
 
 void
 nvkm_event_fini(struct nvkm_event *event)
 {
 	if (event->refs) {
+		kfree(event->list);
 		kfree(event->refs);
 		event->refs = NULL;
 	}
@@ -84,16 +88,26 @@ int
 nvkm_event_init(const struct nvkm_event_func *func, int types_nr, int index_nr,
 		struct nvkm_event *event)
 {
+	int i;
+
+	event->list = kmalloc(sizeof(*event->list) * index_nr, GFP_KERNEL);
+	if (!event->list)
+		return -ENOMEM;
+
 	event->refs = kzalloc(sizeof(*event->refs) * index_nr * types_nr,
 			      GFP_KERNEL);
-	if (!event->refs)
+	if (!event->refs) {
+		kfree(event->list);
 		return -ENOMEM;
+	}
+
+	for (i = 0; i < index_nr; i++)
+		INIT_LIST_HEAD(&event->list[i]);
 
 	event->func = func;
 	event->types_nr = types_nr;
 	event->index_nr = index_nr;
 	spin_lock_init(&event->refs_lock);
 	spin_lock_init(&event->list_lock);
-	INIT_LIST_HEAD(&event->list);
 	return 0;
 }
@@ -188,6 +188,55 @@ nvkm_gpuobj_ctor(struct nvkm_device *device, u32 size, int align, bool zero,
 	return nvkm_mm_init(&gpuobj->heap, 0, gpuobj->size, 1);
 }
 
+/* gpuobjs are small and short-lived, allocate them from a slab cache that
+ * lives for as long as any device does, as nvkm_mm's node cache does
+ */
+static DEFINE_MUTEX(nvkm_gpuobj_cache_mutex);
+static struct kmem_cache *nvkm_gpuobj_cache;
+static int nvkm_gpuobj_cache_users;
+
+/* each call must be balanced by nvkm_gpuobj_cache_fini(), even if it fails */
+int
+nvkm_gpuobj_cache_init(void)
+{
+	int ret = 0;
+
+	mutex_lock(&nvkm_gpuobj_cache_mutex);
+	nvkm_gpuobj_cache_users++;
+	if (!nvkm_gpuobj_cache) {
+		nvkm_gpuobj_cache = kmem_cache_create("nvkm_gpuobj",
+						      sizeof(struct nvkm_gpuobj),
+						      0, 0, NULL);
+		if (!nvkm_gpuobj_cache)
+			ret = -ENOMEM;
+	}
+	mutex_unlock(&nvkm_gpuobj_cache_mutex);
+	return ret;
+}
+
+void
+nvkm_gpuobj_cache_fini(void)
+{
+	mutex_lock(&nvkm_gpuobj_cache_mutex);
+	if (!--nvkm_gpuobj_cache_users) {
+		kmem_cache_destroy(nvkm_gpuobj_cache);
+		nvkm_gpuobj_cache = NULL;
+	}
+	mutex_unlock(&nvkm_gpuobj_cache_mutex);
+}
+
+static struct nvkm_gpuobj *
+nvkm_gpuobj_alloc(void)
+{
+	return kmem_cache_zalloc(nvkm_gpuobj_cache, GFP_KERNEL);
+}
+
+static void
+nvkm_gpuobj_free(struct nvkm_gpuobj *gpuobj)
+{
+	kmem_cache_free(nvkm_gpuobj_cache, gpuobj);
+}
+
 void
 nvkm_gpuobj_del(struct nvkm_gpuobj **pgpuobj)
 {
@@ -197,7 +246,7 @@ nvkm_gpuobj_del(struct nvkm_gpuobj **pgpuobj)
 			nvkm_mm_free(&gpuobj->parent->heap, &gpuobj->node);
 		nvkm_mm_fini(&gpuobj->heap);
 		nvkm_memory_del(&gpuobj->memory);
-		kfree(*pgpuobj);
+		nvkm_gpuobj_free(*pgpuobj);
 		*pgpuobj = NULL;
 	}
 }
@@ -209,7 +258,7 @@ nvkm_gpuobj_new(struct nvkm_device *device, u32 size, int align, bool zero,
 	struct nvkm_gpuobj *gpuobj;
 	int ret;
 
-	if (!(gpuobj = *pgpuobj = kzalloc(sizeof(*gpuobj), GFP_KERNEL)))
+	if (!(gpuobj = *pgpuobj = nvkm_gpuobj_alloc()))
 		return -ENOMEM;
 
 	ret = nvkm_gpuobj_ctor(device, size, align, zero, parent, gpuobj);
@@ -246,7 +295,7 @@ nvkm_gpuobj_unmap(struct nvkm_vma *vma)
 int
 nvkm_gpuobj_wrap(struct nvkm_memory *memory, struct nvkm_gpuobj **pgpuobj)
 {
-	if (!(*pgpuobj = kzalloc(sizeof(**pgpuobj), GFP_KERNEL)))
+	if (!(*pgpuobj = nvkm_gpuobj_alloc()))
 		return -ENOMEM;
 
 	(*pgpuobj)->addr = nvkm_memory_addr(memory);
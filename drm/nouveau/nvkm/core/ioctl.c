@@ -77,6 +77,18 @@ nvkm_ioctl_sclass(struct nvkm_object *object, void *data, u32 size)
 	return ret;
 }
 
+static int
+nvkm_ioctl_new_oclass(struct nvkm_object *parent, struct nvif_ioctl_new_v0 *args,
+		      int index, struct nvkm_oclass *oclass)
+{
+	memset(oclass, 0x00, sizeof(*oclass));
+	oclass->client = parent->client;
+	oclass->handle = args->handle;
+	oclass->object = args->object;
+	oclass->parent = parent;
+	return parent->func->sclass(parent, index, oclass);
+}
+
 static int
 nvkm_ioctl_new(struct nvkm_object *parent, void *data, u32 size)
 {
@@ -86,7 +98,7 @@ nvkm_ioctl_new(struct nvkm_object *parent, void *data, u32 size)
 	struct nvkm_client *client = parent->client;
 	struct nvkm_object *object = NULL;
 	struct nvkm_oclass oclass;
-	int ret, i = 0;
+	int ret, i;
 
 	nvif_ioctl(parent, "new size %d\n", size);
 	if (nvif_unpack(args->v0, 0, 0, true)) {
@@ -102,16 +114,26 @@ nvkm_ioctl_new(struct nvkm_object *parent, void *data, u32 size)
 		return -EINVAL;
 	}
 
-	do {
-		memset(&oclass, 0x00, sizeof(oclass));
-		oclass.client = client;
-		oclass.handle = args->v0.handle;
-		oclass.object = args->v0.object;
-		oclass.parent = parent;
-		ret = parent->func->sclass(parent, i++, &oclass);
-		if (ret)
-			return ret;
-	} while (oclass.base.oclass != args->v0.oclass);
+	/* find the class's index from the parent's lookup table, falling back
+	 * to searching the list (and rebuilding the table) if it's stale
+	 */
+	if ((i = nvkm_object_sclass(parent, args->v0.oclass)) >= 0) {
+		ret = nvkm_ioctl_new_oclass(parent, &args->v0, i, &oclass);
+		if (ret || oclass.base.oclass != args->v0.oclass) {
+			nvkm_object_sclass_fini(parent);
+			i = -1;
+		}
+	}
+
+	if (i < 0) {
+		i = 0;
+		do {
+			ret = nvkm_ioctl_new_oclass(parent, &args->v0, i++,
+						    &oclass);
+			if (ret)
+				return ret;
+		} while (oclass.base.oclass != args->v0.oclass);
+	}
 
 	if (oclass.engine) {
 		oclass.engine = nvkm_engine_ref(oclass.engine);
@@ -245,6 +267,185 @@ nvkm_ioctl_wr(struct nvkm_object *object, void *data, u32 size)
 	return -EINVAL;
 }
 
+static int
+nvkm_ioctl_rwv_rd(struct nvkm_object *object, u8 size, u64 addr, u32 *data)
+{
+	union {
+		u8  b08;
+		u16 b16;
+		u32 b32;
+	} v;
+	int ret;
+
+	switch (size) {
+	case 1:
+		ret = nvkm_object_rd08(object, addr, &v.b08);
+		*data = v.b08;
+		break;
+	case 2:
+		ret = nvkm_object_rd16(object, addr, &v.b16);
+		*data = v.b16;
+		break;
+	case 4:
+		ret = nvkm_object_rd32(object, addr, &v.b32);
+		*data = v.b32;
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
+static int
+nvkm_ioctl_rwv_wr(struct nvkm_object *object, u8 size, u64 addr, u32 data)
+{
+	switch (size) {
+	case 1: return nvkm_object_wr08(object, addr, data);
+	case 2: return nvkm_object_wr16(object, addr, data);
+	case 4: return nvkm_object_wr32(object, addr, data);
+	default:
+		break;
+	}
+
+	return -EINVAL;
+}
+
+static int
+nvkm_ioctl_rdv(struct nvkm_object *object, void *data, u32 size)
+{
+	union {
+		struct nvif_ioctl_rwv_v0 v0;
+	} *args = data;
+	struct nvif_ioctl_rwv_op_v0 *op;
+	int ret, i;
+
+	nvif_ioctl(object, "rdv size %d\n", size);
+	if (nvif_unpack(args->v0, 0, 0, true)) {
+		nvif_ioctl(object, "rdv vers %d count %d\n",
+			   args->v0.version, args->v0.count);
+		if (size % sizeof(args->v0.op[0]) ||
+		    size / sizeof(args->v0.op[0]) != args->v0.count)
+			return -EINVAL;
+
+		for (i = 0, op = args->v0.op; i < args->v0.count; i++, op++) {
+			op->status = nvkm_ioctl_rwv_rd(object, op->size,
+						       op->addr, &op->data);
+			op->data &= op->mask;
+		}
+	}
+
+	return ret;
+}
+
+static int
+nvkm_ioctl_wrv(struct nvkm_object *object, void *data, u32 size)
+{
+	union {
+		struct nvif_ioctl_rwv_v0 v0;
+	} *args = data;
+	struct nvif_ioctl_rwv_op_v0 *op;
+	u32 temp, full;
+	int ret, i;
+
+	nvif_ioctl(object, "wrv size %d\n", size);
+	if (nvif_unpack(args->v0, 0, 0, true)) {
+		nvif_ioctl(object, "wrv vers %d count %d\n",
+			   args->v0.version, args->v0.count);
+		if (size % sizeof(args->v0.op[0]) ||
+		    size / sizeof(args->v0.op[0]) != args->v0.count)
+			return -EINVAL;
+
+		for (i = 0, op = args->v0.op; i < args->v0.count; i++, op++) {
+			if (op->size != 1 && op->size != 2 && op->size != 4) {
+				op->status = -EINVAL;
+				continue;
+			}
+
+			/* partial masks are a read-modify-write */
+			full = 0xffffffff >> (32 - op->size * 8);
+			temp = op->data;
+			if ((op->mask & full) != full) {
+				op->status = nvkm_ioctl_rwv_rd(object, op->size,
+							       op->addr, &temp);
+				if (op->status)
+					continue;
+				temp &= ~op->mask;
+				temp |= op->data & op->mask;
+			}
+			op->status = nvkm_ioctl_rwv_wr(object, op->size,
+						       op->addr, temp);
+		}
+	}
+
+	return ret;
+}
+
+static int nvkm_ioctl_exec(struct nvkm_client *, void *data, u32 size);
+
+static int
+nvkm_ioctl_batch(struct nvkm_object *object, void *data, u32 size)
+{
+	struct nvkm_client *client = object->client;
+	union {
+		struct nvif_ioctl_batch_v0 v0;
+	} *args = data;
+	struct nvif_ioctl_batch_rec_v0 *rec;
+	union {
+		struct nvif_ioctl_v0 v0;
+	} *ioctl;
+	u32 i, next;
+	int ret;
+
+	nvif_ioctl(object, "batch size %d\n", size);
+	if (nvif_unpack(args->v0, 0, 0, true)) {
+		nvif_ioctl(object, "batch vers %d count %d\n",
+			   args->v0.version, args->v0.count);
+		if (object != &client->object)
+			return -EINVAL;
+
+		/* validate the whole container before executing any of it */
+		for (i = 0, next = 0; i < args->v0.count; i++) {
+			if (next > size || size - next < sizeof(*rec))
+				return -EINVAL;
+			rec = (void *)(args->v0.data + next);
+			if (rec->size > size - next - sizeof(*rec))
+				return -EINVAL;
+			next += ALIGN(sizeof(*rec) + rec->size, 8);
+		}
+
+		/* notify requests are rejected, as the layers between us and
+		 * the client (usif, the shm server) translate their tokens
+		 * and only look at the top-level request to do so
+		 */
+		for (i = 0, next = 0; i < args->v0.count; i++) {
+			rec = (void *)(args->v0.data + next);
+			ioctl = (void *)rec->data;
+			rec->ret = -EINVAL;
+			if (rec->size >= sizeof(ioctl->v0)) {
+				switch (ioctl->v0.type) {
+				case NVIF_IOCTL_V0_BATCH:
+				case NVIF_IOCTL_V0_NTFY_NEW:
+				case NVIF_IOCTL_V0_NTFY_DEL:
+				case NVIF_IOCTL_V0_NTFY_GET:
+				case NVIF_IOCTL_V0_NTFY_PUT:
+					break;
+				default:
+					rec->ret = nvkm_ioctl_exec(client,
+								   rec->data,
+								   rec->size);
+					break;
+				}
+			}
+			client->data = NULL;
+			next += ALIGN(sizeof(*rec) + rec->size, 8);
+		}
+	}
+
+	return ret;
+}
+
 static int
 nvkm_ioctl_map(struct nvkm_object *object, void *data, u32 size)
 {
@@ -380,6 +581,9 @@ nvkm_ioctl_v0[] = {
 	{ 0x00, nvkm_ioctl_ntfy_del },
 	{ 0x00, nvkm_ioctl_ntfy_get },
 	{ 0x00, nvkm_ioctl_ntfy_put },
+	{ 0x00, nvkm_ioctl_rdv },
+	{ 0x00, nvkm_ioctl_wrv },
+	{ 0x00, nvkm_ioctl_batch },
 };
 
 static int
@@ -413,9 +617,8 @@ nvkm_ioctl_path(struct nvkm_client *client, u64 handle, u32 type,
 	return ret;
 }
 
-int
-nvkm_ioctl(struct nvkm_client *client, bool supervisor,
-	   void *data, u32 size, void **hack)
+static int
+nvkm_ioctl_exec(struct nvkm_client *client, void *data, u32 size)
 {
 	struct nvkm_object *object = &client->object;
 	union {
@@ -423,7 +626,6 @@ nvkm_ioctl(struct nvkm_client *client, bool supervisor,
 	} *args = data;
 	int ret;
 
-	client->super = supervisor;
 	nvif_ioctl(object, "size %d\n", size);
 
 	if (nvif_unpack(args->v0, 0, 0, true)) {
@@ -437,6 +639,17 @@ nvkm_ioctl(struct nvkm_client *client, bool supervisor,
 	}
 
 	nvif_ioctl(object, "return %d\n", ret);
+	return ret;
+}
+
+int
+nvkm_ioctl(struct nvkm_client *client, bool supervisor,
+	   void *data, u32 size, void **hack)
+{
+	int ret;
+
+	client->super = supervisor;
+	ret = nvkm_ioctl_exec(client, data, size);
 	if (hack) {
 		*hack = client->data;
 		client->data = NULL;
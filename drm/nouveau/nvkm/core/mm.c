@@ -26,6 +26,45 @@
 #define node(root, dir) ((root)->nl_entry.dir == &mm->nodes) ? NULL :          \
 	list_entry((root)->nl_entry.dir, struct nvkm_mm_node, nl_entry)
 
+/* nodes are split and merged at a high rate, allocate them from a slab
+ * cache that's shared between all nvkm_mm instances.  the cache lives for
+ * as long as any device does, every nvkm_mm belongs to one, so allocations
+ * don't need to take a reference of their own
+ */
+static DEFINE_MUTEX(nvkm_mm_cache_mutex);
+static struct kmem_cache *nvkm_mm_cache;
+static int nvkm_mm_cache_users;
+
+/* each call must be balanced by nvkm_mm_cache_fini(), even if it fails */
+int
+nvkm_mm_cache_init(void)
+{
+	int ret = 0;
+
+	mutex_lock(&nvkm_mm_cache_mutex);
+	nvkm_mm_cache_users++;
+	if (!nvkm_mm_cache) {
+		nvkm_mm_cache = kmem_cache_create("nvkm_mm_node",
+						  sizeof(struct nvkm_mm_node),
+						  0, 0, NULL);
+		if (!nvkm_mm_cache)
+			ret = -ENOMEM;
+	}
+	mutex_unlock(&nvkm_mm_cache_mutex);
+	return ret;
+}
+
+void
+nvkm_mm_cache_fini(void)
+{
+	mutex_lock(&nvkm_mm_cache_mutex);
+	if (!--nvkm_mm_cache_users) {
+		kmem_cache_destroy(nvkm_mm_cache);
+		nvkm_mm_cache = NULL;
+	}
+	mutex_unlock(&nvkm_mm_cache_mutex);
+}
+
 void
 nvkm_mm_dump(struct nvkm_mm *mm, const char *header)
 {
@@ -56,7 +95,7 @@ nvkm_mm_free(struct nvkm_mm *mm, struct nvkm_mm_node **pthis)
 		if (prev && prev->type == NVKM_MM_TYPE_NONE) {
 			prev->length += this->length;
 			list_del(&this->nl_entry);
-			kfree(this); this = prev;
+			kmem_cache_free(nvkm_mm_cache, this); this = prev;
 		}
 
 		if (next && next->type == NVKM_MM_TYPE_NONE) {
@@ -65,7 +104,7 @@ nvkm_mm_free(struct nvkm_mm *mm, struct nvkm_mm_node **pthis)
 			if (this->type == NVKM_MM_TYPE_NONE)
 				list_del(&this->fl_entry);
 			list_del(&this->nl_entry);
-			kfree(this); this = NULL;
+			kmem_cache_free(nvkm_mm_cache, this); this = NULL;
 		}
 
 		if (this && this->type != NVKM_MM_TYPE_NONE) {
@@ -90,7 +129,7 @@ region_head(struct nvkm_mm *mm, struct nvkm_mm_node *a, u32 size)
 	if (a->length == size)
 		return a;
 
-	b = kmalloc(sizeof(*b), GFP_KERNEL);
+	b = kmem_cache_alloc(nvkm_mm_cache, GFP_KERNEL);
 	if (unlikely(b == NULL))
 		return NULL;
 
@@ -164,7 +203,7 @@ region_tail(struct nvkm_mm *mm, struct nvkm_mm_node *a, u32 size)
 	if (a->length == size)
 		return a;
 
-	b = kmalloc(sizeof(*b), GFP_KERNEL);
+	b = kmem_cache_alloc(nvkm_mm_cache, GFP_KERNEL);
 	if (unlikely(b == NULL))
 		return NULL;
 
@@ -245,7 +284,8 @@ nvkm_mm_init(struct nvkm_mm *mm, u32 offset, u32 length, u32 block)
 		next = prev->offset + prev->length;
 		if (next != offset) {
 			BUG_ON(next > offset);
-			if (!(node = kzalloc(sizeof(*node), GFP_KERNEL)))
+			node = kmem_cache_zalloc(nvkm_mm_cache, GFP_KERNEL);
+			if (!node)
 				return -ENOMEM;
 			node->type   = NVKM_MM_TYPE_HOLE;
 			node->offset = next;
@@ -260,7 +300,7 @@ nvkm_mm_init(struct nvkm_mm *mm, u32 offset, u32 length, u32 block)
 		mm->heap_nodes = 0;
 	}
 
-	node = kzalloc(sizeof(*node), GFP_KERNEL);
+	node = kmem_cache_zalloc(nvkm_mm_cache, GFP_KERNEL);
 	if (!node)
 		return -ENOMEM;
 
@@ -296,7 +336,7 @@ nvkm_mm_fini(struct nvkm_mm *mm)
 
 	list_for_each_entry_safe(node, temp, &mm->nodes, nl_entry) {
 		list_del(&node->nl_entry);
-		kfree(node);
+		kmem_cache_free(nvkm_mm_cache, node);
 	}
 
 	mm->heap_nodes = 0;
@@ -72,6 +72,9 @@ nvkm_notify_func(struct nvkm_notify *notify)
 	struct nvkm_event *event = notify->event;
 	int ret = notify->func(notify);
 	unsigned long flags;
+	/* another sender may claim the notifier as soon as it's re-armed */
+	if (!test_bit(NVKM_NOTIFY_WORK, &notify->flags))
+		notify->data = NULL;
 	if ((ret == NVKM_NOTIFY_KEEP) ||
 	    !test_and_clear_bit(NVKM_NOTIFY_USER, &notify->flags)) {
 		spin_lock_irqsave(&event->refs_lock, flags);
@@ -93,7 +96,6 @@ nvkm_notify_send(struct nvkm_notify *notify, void *data, u32 size)
 	struct nvkm_event *event = notify->event;
 	unsigned long flags;
 
-	assert_spin_locked(&event->list_lock);
 	BUG_ON(size != notify->size);
 
 	spin_lock_irqsave(&event->refs_lock, flags);
@@ -110,7 +112,6 @@ nvkm_notify_send(struct nvkm_notify *notify, void *data, u32 size)
 	} else {
 		notify->data = data;
 		nvkm_notify_func(notify);
-		notify->data = NULL;
 	}
 }
 
@@ -121,8 +122,9 @@ nvkm_notify_fini(struct nvkm_notify *notify)
 	if (notify->event) {
 		nvkm_notify_put(notify);
 		spin_lock_irqsave(&notify->event->list_lock, flags);
-		list_del(&notify->head);
+		list_del_rcu(&notify->head);
 		spin_unlock_irqrestore(&notify->event->list_lock, flags);
+		synchronize_rcu();
 		kfree((void *)notify->data);
 		notify->event = NULL;
 	}
@@ -138,7 +140,8 @@ nvkm_notify_init(struct nvkm_object *object, struct nvkm_event *event,
 	int ret = -ENODEV;
 	if ((notify->event = event), event->refs) {
 		ret = event->func->ctor(object, data, size, notify);
-		if (ret == 0 && (ret = -EINVAL, notify->size == reply)) {
+		if (ret == 0 && (ret = -EINVAL, notify->size == reply) &&
+		    !WARN_ON(notify->index >= event->index_nr)) {
 			notify->flags = 0;
 			notify->block = 1;
 			notify->func = func;
@@ -153,7 +156,8 @@ nvkm_notify_init(struct nvkm_object *object, struct nvkm_event *event,
 		}
 		if (ret == 0) {
 			spin_lock_irqsave(&event->list_lock, flags);
-			list_add_tail(&notify->head, &event->list);
+			list_add_tail_rcu(&notify->head,
+					  &event->list[notify->index]);
 			spin_unlock_irqrestore(&event->list_lock, flags);
 		}
 	}
@@ -107,6 +107,94 @@ nvkm_object_bind(struct nvkm_object *object, struct nvkm_gpuobj *gpuobj,
 	return -ENODEV;
 }
 
+/* lookup table from class id to the index that the parent's sclass()
+ * method returns it at, so object creation doesn't have to walk the
+ * entire list for every new child
+ */
+struct nvkm_object_sclass {
+	u32 mask;
+	struct {
+		s32 oclass;
+		int index; /* +1, 0 marks an empty slot */
+	} hash[];
+};
+
+static int
+nvkm_object_sclass_get(struct nvkm_object *object, int index,
+		       struct nvkm_oclass *oclass)
+{
+	memset(oclass, 0x00, sizeof(*oclass));
+	oclass->client = object->client;
+	oclass->parent = object;
+	return object->func->sclass(object, index, oclass);
+}
+
+static struct nvkm_object_sclass *
+nvkm_object_sclass_new(struct nvkm_object *object)
+{
+	struct nvkm_object_sclass *map;
+	struct nvkm_oclass oclass;
+	int count = 0, bits, i;
+	u32 hash;
+
+	while (nvkm_object_sclass_get(object, count, &oclass) >= 0)
+		count++;
+
+	bits = order_base_2(max_t(int, count, 4) * 2);
+	map = kzalloc(sizeof(*map) + (1 << bits) * sizeof(map->hash[0]),
+		      GFP_KERNEL);
+	if (!map)
+		return NULL;
+	map->mask = (1 << bits) - 1;
+
+	for (i = 0; i < count; i++) {
+		if (nvkm_object_sclass_get(object, i, &oclass) < 0)
+			break;
+
+		/* first match wins, as it would when searching the list */
+		hash = hash_32(oclass.base.oclass, bits);
+		while (map->hash[hash].index &&
+		       map->hash[hash].oclass != oclass.base.oclass)
+			hash = (hash + 1) & map->mask;
+
+		if (!map->hash[hash].index) {
+			map->hash[hash].oclass = oclass.base.oclass;
+			map->hash[hash].index = i + 1;
+		}
+	}
+
+	return map;
+}
+
+int
+nvkm_object_sclass(struct nvkm_object *object, s32 oclass)
+{
+	struct nvkm_object_sclass *map = object->sclass;
+	u32 hash;
+
+	if (!object->func->sclass)
+		return -ENODEV;
+
+	if (!map && !(map = object->sclass = nvkm_object_sclass_new(object)))
+		return -ENOMEM;
+
+	hash = hash_32(oclass, order_base_2(map->mask + 1));
+	while (map->hash[hash].index) {
+		if (map->hash[hash].oclass == oclass)
+			return map->hash[hash].index - 1;
+		hash = (hash + 1) & map->mask;
+	}
+
+	return -ENOENT;
+}
+
+void
+nvkm_object_sclass_fini(struct nvkm_object *object)
+{
+	kfree(object->sclass);
+	object->sclass = NULL;
+}
+
 int
 nvkm_object_fini(struct nvkm_object *object, bool suspend)
 {
@@ -200,6 +288,7 @@ nvkm_object_dtor(struct nvkm_object *object)
 	}
 
 	nvif_debug(object, "destroy running...\n");
+	nvkm_object_sclass_fini(object);
 	if (object->func->dtor)
 		data = object->func->dtor(object);
 	nvkm_engine_unref(&object->engine);
@@ -233,6 +322,7 @@ nvkm_object_ctor(const struct nvkm_object_func *func,
 	INIT_LIST_HEAD(&object->head);
 	INIT_LIST_HEAD(&object->tree);
 	RB_CLEAR_NODE(&object->node);
+	object->sclass = NULL;
 	WARN_ON(oclass->engine && !object->engine);
 }
 
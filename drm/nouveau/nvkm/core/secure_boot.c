@@ -584,7 +584,7 @@ lsf_ucode_img_build(const struct firmware *bl, const struct firmware *code,
 static int
 lsf_ucode_img_load_fecs(struct nvkm_device *device, struct lsf_ucode_img *img)
 {
-	const struct firmware *fecs_bl, *fecs_code, *fecs_data;
+	const struct firmware *fecs_bl, *fecs_code, *fecs_data, *fecs_sig;
 	struct lsf_ucode_desc *lsf_desc;
 	int err;
 
@@ -610,16 +610,20 @@ lsf_ucode_img_load_fecs(struct nvkm_device *device, struct lsf_ucode_img *img)
 	}
 	img->ucode_size = img->ucode_desc.image_size;
 
-	lsf_desc = sb_load_firmware(device, "fecs_sig", sizeof(*lsf_desc));
-	if (IS_ERR(lsf_desc)) {
-		err = PTR_ERR(lsf_desc);
+	err = sb_get_firmware(device, "fecs_sig", &fecs_sig);
+	if (err)
+		goto free_image;
+	if (fecs_sig->size < sizeof(*lsf_desc)) {
+		release_firmware(fecs_sig);
+		err = -EINVAL;
 		goto free_image;
 	}
+	lsf_desc = &img->lsb_header.signature;
+	memcpy(lsf_desc, fecs_sig->data, sizeof(*lsf_desc));
+	release_firmware(fecs_sig);
 	/* not needed? the signature should already have the right value */
 	lsf_desc->falcon_id = LSF_FALCON_ID_FECS;
-	memcpy(&img->lsb_header.signature, lsf_desc, sizeof(*lsf_desc));
 	img->falcon_id = lsf_desc->falcon_id;
-	kfree(lsf_desc);
 
 	/* success path - only free requested firmware files */
 	goto free_data;
@@ -75,8 +75,11 @@ nvkm_subdev_name[NVKM_SUBDEV_NR] = {
 void
 nvkm_subdev_intr(struct nvkm_subdev *subdev)
 {
-	if (subdev->func->intr)
+	if (subdev->func->intr) {
+		int mmio = nvkm_mmio_subdev(subdev->index);
 		subdev->func->intr(subdev);
+		nvkm_mmio_subdev(mmio);
+	}
 }
 
 int
@@ -85,17 +88,21 @@ nvkm_subdev_fini(struct nvkm_subdev *subdev, bool suspend)
 	struct nvkm_device *device = subdev->device;
 	const char *action = suspend ? "suspend" : "fini";
 	u32 pmc_enable = subdev->pmc_enable;
+	int mmio;
 	s64 time;
 
 	nvkm_trace(subdev, "%s running...\n", action);
 	time = ktime_to_us(ktime_get());
+	mmio = nvkm_mmio_subdev(subdev->index);
 
 	if (subdev->func->fini) {
 		int ret = subdev->func->fini(subdev, suspend);
 		if (ret) {
 			nvkm_error(subdev, "%s failed, %d\n", action, ret);
-			if (suspend)
+			if (suspend) {
+				nvkm_mmio_subdev(mmio);
 				return ret;
+			}
 		}
 	}
 
@@ -105,6 +112,8 @@ nvkm_subdev_fini(struct nvkm_subdev *subdev, bool suspend)
 		nvkm_rd32(device, 0x000200);
 	}
 
+	nvkm_mmio_subdev(mmio);
+
 	time = ktime_to_us(ktime_get()) - time;
 	nvkm_trace(subdev, "%s completed in %lldus\n", action, time);
 	return 0;
@@ -119,7 +128,9 @@ nvkm_subdev_preinit(struct nvkm_subdev *subdev)
 	time = ktime_to_us(ktime_get());
 
 	if (subdev->func->preinit) {
+		int mmio = nvkm_mmio_subdev(subdev->index);
 		int ret = subdev->func->preinit(subdev);
+		nvkm_mmio_subdev(mmio);
 		if (ret) {
 			nvkm_error(subdev, "preinit failed, %d\n", ret);
 			return ret;
@@ -135,10 +146,11 @@ int
 nvkm_subdev_init(struct nvkm_subdev *subdev)
 {
 	s64 time;
-	int ret;
+	int mmio, ret;
 
 	nvkm_trace(subdev, "init running...\n");
 	time = ktime_to_us(ktime_get());
+	mmio = nvkm_mmio_subdev(subdev->index);
 
 	if (subdev->func->oneinit && !subdev->oneinit) {
 		s64 time;
@@ -147,6 +159,7 @@ nvkm_subdev_init(struct nvkm_subdev *subdev)
 		ret = subdev->func->oneinit(subdev);
 		if (ret) {
 			nvkm_error(subdev, "one-time init failed, %d\n", ret);
+			nvkm_mmio_subdev(mmio);
 			return ret;
 		}
 
@@ -159,10 +172,13 @@ nvkm_subdev_init(struct nvkm_subdev *subdev)
 		ret = subdev->func->init(subdev);
 		if (ret) {
 			nvkm_error(subdev, "init failed, %d\n", ret);
+			nvkm_mmio_subdev(mmio);
 			return ret;
 		}
 	}
 
+	nvkm_mmio_subdev(mmio);
+
 	time = ktime_to_us(ktime_get()) - time;
 	nvkm_trace(subdev, "init completed in %lldus\n", time);
 	return 0;
@@ -24,6 +24,7 @@
 #include "priv.h"
 #include "acpi.h"
 
+#include <core/gpuobj.h>
 #include <core/notify.h>
 #include <core/option.h>
 #include <core/secure_boot.h>
@@ -50,6 +51,8 @@ nvkm_device_find(u64 handle)
 	struct nvkm_device *device;
 	mutex_lock(&nv_devices_mutex);
 	device = nvkm_device_find_locked(handle);
+	if (device && !device->constructed)
+		device = NULL;
 	mutex_unlock(&nv_devices_mutex);
 	return device;
 }
@@ -61,6 +64,8 @@ nvkm_device_list(u64 *name, int size)
 	int nr = 0;
 	mutex_lock(&nv_devices_mutex);
 	list_for_each_entry(device, &nv_devices, head) {
+		if (!device->constructed)
+			continue;
 		if (nr++ < size)
 			name[nr - 1] = device->handle;
 	}
@@ -2302,6 +2307,9 @@ nvkm_device_del(struct nvkm_device **pdevice)
 
 		kfree(*pdevice);
 		*pdevice = NULL;
+
+		nvkm_gpuobj_cache_fini();
+		nvkm_mm_cache_fini();
 	}
 }
 
@@ -2317,12 +2325,25 @@ nvkm_device_ctor(const struct nvkm_device_func *func,
 	u64 mmio_base, mmio_size;
 	u32 boot0, strap;
 	void __iomem *map;
-	int ret = -EEXIST;
+	int ret;
 	int i;
 
+	/* the slab caches backing every device's mm nodes and gpuobjs are
+	 * kept for as long as any device is, nvkm_device_del() drops these
+	 */
+	ret = nvkm_mm_cache_init();
+	if (nvkm_gpuobj_cache_init() || ret)
+		return -ENOMEM;
+
+	/* the list lock only covers claiming the handle, so that several
+	 * devices can be constructed at the same time.  the device stays
+	 * hidden from find/list until construction has succeeded
+	 */
 	mutex_lock(&nv_devices_mutex);
-	if (nvkm_device_find_locked(handle))
-		goto done;
+	if (nvkm_device_find_locked(handle)) {
+		mutex_unlock(&nv_devices_mutex);
+		return -EEXIST;
+	}
 
 	device->func = func;
 	device->quirk = quirk;
@@ -2332,7 +2353,10 @@ nvkm_device_ctor(const struct nvkm_device_func *func,
 	device->cfgopt = cfg;
 	device->dbgopt = dbg;
 	device->name = name;
+	device->constructed = false;
 	list_add_tail(&device->head, &nv_devices);
+	mutex_unlock(&nv_devices_mutex);
+
 	device->debug = nvkm_dbgopt(device->dbgopt, "device");
 
 	ret = nvkm_event_init(&nvkm_device_event_func, 1, 1, &device->event);
@@ -2583,6 +2607,10 @@ nvkm_device_ctor(const struct nvkm_device_func *func,
 		ret = nvkm_secure_boot_init(device);
 
 done:
-	mutex_unlock(&nv_devices_mutex);
+	if (ret == 0) {
+		mutex_lock(&nv_devices_mutex);
+		device->constructed = true;
+		mutex_unlock(&nv_devices_mutex);
+	}
 	return ret;
 }
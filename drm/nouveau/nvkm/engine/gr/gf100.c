@@ -1612,7 +1612,8 @@ gf100_gr_init_(struct nvkm_gr *base)
 void
 gf100_gr_dtor_fw(struct gf100_gr_fuc *fuc)
 {
-	kfree(fuc->data);
+	release_firmware(fuc->fw);
+	fuc->fw = NULL;
 	fuc->data = NULL;
 }
 
@@ -1674,10 +1675,13 @@ gf100_gr_ctor_fw(struct gf100_gr *gr, const char *fwname,
 		return ret;
 	}
 
+	/* the image is only ever read, hold on to the firmware rather than
+	 * making a private copy of it
+	 */
+	fuc->fw = fw;
 	fuc->size = fw->size;
-	fuc->data = kmemdup(fw->data, fuc->size, GFP_KERNEL);
-	release_firmware(fw);
-	return (fuc->data != NULL) ? 0 : -ENOMEM;
+	fuc->data = (const u32 *)fw->data;
+	return 0;
 }
 
 int
@@ -54,7 +54,8 @@ struct gf100_gr_mmio {
 };
 
 struct gf100_gr_fuc {
-	u32 *data;
+	const struct firmware *fw;
+	const u32 *data;
 	u32  size;
 };
 
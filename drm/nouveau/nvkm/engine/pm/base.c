@@ -210,6 +210,7 @@ nvkm_perfdom_init(struct nvkm_perfdom *dom, void *data, u32 size)
 	} *args = data;
 	struct nvkm_object *object = &dom->object;
 	struct nvkm_pm *pm = dom->perfmon->pm;
+	struct nvkm_object *child;
 	int ret, i;
 
 	nvif_ioctl(object, "perfdom init size %d\n", size);
@@ -227,6 +228,16 @@ nvkm_perfdom_init(struct nvkm_perfdom *dom, void *data, u32 size)
 		}
 	}
 
+	/* any other perfdom set up on the same domain has now lost its
+	 * counters to this one
+	 */
+	list_for_each_entry(child, &dom->perfmon->object.tree, head) {
+		struct nvkm_perfdom *temp = nvkm_perfdom(child);
+		if (temp->func == dom->func && temp->addr == dom->addr)
+			temp->active = false;
+	}
+	dom->active = true;
+
 	/* start next batch of counters for sampling */
 	dom->func->next(pm, dom);
 	return 0;
@@ -256,6 +267,18 @@ nvkm_perfdom_sample(struct nvkm_perfdom *dom, void *data, u32 size)
 	return 0;
 }
 
+static void
+nvkm_perfdom_snapshot(struct nvkm_perfdom *dom)
+{
+	struct nvkm_pm *pm = dom->perfmon->pm;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (dom->ctr[i])
+			dom->func->read(pm, dom, dom->ctr[i]);
+	}
+}
+
 static int
 nvkm_perfdom_read(struct nvkm_perfdom *dom, void *data, u32 size)
 {
@@ -263,7 +286,6 @@ nvkm_perfdom_read(struct nvkm_perfdom *dom, void *data, u32 size)
 		struct nvif_perfdom_read_v0 v0;
 	} *args = data;
 	struct nvkm_object *object = &dom->object;
-	struct nvkm_pm *pm = dom->perfmon->pm;
 	int ret, i;
 
 	nvif_ioctl(object, "perfdom read size %d\n", size);
@@ -272,11 +294,7 @@ nvkm_perfdom_read(struct nvkm_perfdom *dom, void *data, u32 size)
 	} else
 		return ret;
 
-	for (i = 0; i < 4; i++) {
-		if (dom->ctr[i])
-			dom->func->read(pm, dom, dom->ctr[i]);
-	}
-
+	nvkm_perfdom_snapshot(dom);
 	if (!dom->clk)
 		return -EAGAIN;
 
@@ -582,6 +600,56 @@ nvkm_perfmon_mthd_query_source(struct nvkm_perfmon *perfmon,
 	return 0;
 }
 
+/* reads back the counters of every perfdom that's currently counting, the
+ * caller supplies room for count perfdoms, and count is returned as the
+ * total number of them, which may be larger
+ */
+static int
+nvkm_perfmon_mthd_read_all(struct nvkm_perfmon *perfmon, void *data, u32 size)
+{
+	union {
+		struct nvif_perfmon_read_all_v0 v0;
+	} *args = data;
+	struct nvkm_object *object = &perfmon->object;
+	struct nvkm_object *child;
+	u32 count = 0;
+	int ret, i;
+
+	nvif_ioctl(object, "perfmon read all size %d\n", size);
+	if (nvif_unpack(args->v0, 0, 0, true)) {
+		nvif_ioctl(object, "perfmon read all vers %d count %d\n",
+			   args->v0.version, args->v0.count);
+		if (size % sizeof(args->v0.dom[0]) ||
+		    size / sizeof(args->v0.dom[0]) != args->v0.count)
+			return -EINVAL;
+	} else
+		return ret;
+
+	/* children are added at the head, walk them in creation order */
+	list_for_each_entry_reverse(child, &object->tree, head) {
+		struct nvkm_perfdom *dom = nvkm_perfdom(child);
+
+		if (!dom->active)
+			continue;
+
+		if (count < args->v0.count) {
+			u32 *ctr = args->v0.dom[count].ctr;
+
+			nvkm_perfdom_snapshot(dom);
+			for (i = 0; i < 4; i++) {
+				if (dom->ctr[i])
+					ctr[i] = dom->ctr[i]->ctr;
+			}
+			args->v0.dom[count].object = child->object;
+			args->v0.dom[count].clk = dom->clk;
+		}
+		count++;
+	}
+
+	args->v0.count = count;
+	return 0;
+}
+
 static int
 nvkm_perfmon_mthd(struct nvkm_object *object, u32 mthd, void *data, u32 size)
 {
@@ -593,6 +661,8 @@ nvkm_perfmon_mthd(struct nvkm_object *object, u32 mthd, void *data, u32 size)
 		return nvkm_perfmon_mthd_query_signal(perfmon, data, size);
 	case NVIF_PERFMON_V0_QUERY_SOURCE:
 		return nvkm_perfmon_mthd_query_source(perfmon, data, size);
+	case NVIF_PERFMON_V0_READ_ALL:
+		return nvkm_perfmon_mthd_read_all(perfmon, data, size);
 	default:
 		break;
 	}
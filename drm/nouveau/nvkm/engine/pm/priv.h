@@ -79,6 +79,7 @@ struct nvkm_perfdom {
 	u32 addr;
 	u8  mode;
 	u32 clk;
+	bool active;
 	u16 signal_nr;
 	struct nvkm_perfsig signal[];
 };
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <nvif/async.h>
+#include <nvif/client.h>
+#include <nvif/ioctl.h>
+
+/* requests are executed strictly in submission order by a single worker
+ * per queue.  the ring only holds pointers to the caller's requests, the
+ * ioctl arguments themselves are copied into a buffer owned by the request
+ * until it completes.
+ */
+static void *
+nvif_async_worker(void *arg)
+{
+	struct nvif_async *async = arg;
+	struct nvif_async_req *req;
+
+	pthread_mutex_lock(&async->mutex);
+	for (;;) {
+		while (async->get == async->put && !async->fini)
+			pthread_cond_wait(&async->work, &async->mutex);
+		if (async->get == async->put)
+			break;
+
+		req = async->ring[async->get++ % async->depth];
+		pthread_cond_signal(&async->space);
+		pthread_mutex_unlock(&async->mutex);
+
+		req->ret = nvif_object_ioctl(req->object, req->args,
+					     req->skip + req->size, NULL);
+		memcpy(req->data, (u8 *)req->args + req->skip, req->size);
+		kfree(req->args);
+		req->args = NULL;
+
+		if (req->func) {
+			req->func(req);
+			pthread_mutex_lock(&async->mutex);
+		} else {
+			pthread_mutex_lock(&async->mutex);
+			__atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+			pthread_cond_broadcast(&async->done);
+		}
+	}
+	pthread_mutex_unlock(&async->mutex);
+	return NULL;
+}
+
+static int
+nvif_async_submit(struct nvif_async *async, struct nvif_async_req *req,
+		  struct nvif_object *object, void *args, u32 skip,
+		  void *data, u32 size)
+{
+	req->ret = 0;
+	req->object = object;
+	req->data = data;
+	req->size = size;
+	req->args = args;
+	req->skip = skip;
+	req->done = false;
+	memcpy((u8 *)args + skip, data, size);
+
+	pthread_mutex_lock(&async->mutex);
+	while (async->put - async->get == async->depth)
+		pthread_cond_wait(&async->space, &async->mutex);
+	async->ring[async->put++ % async->depth] = req;
+	pthread_cond_signal(&async->work);
+	pthread_mutex_unlock(&async->mutex);
+	return 0;
+}
+
+int
+nvif_async_ioctl(struct nvif_async *async, struct nvif_async_req *req,
+		 struct nvif_object *object, void *data, u32 size)
+{
+	void *args;
+
+	if (size < sizeof(struct nvif_ioctl_v0))
+		return -EINVAL;
+	if (!(args = kmalloc(size, GFP_KERNEL)))
+		return -ENOMEM;
+
+	return nvif_async_submit(async, req, object, args, 0, data, size);
+}
+
+int
+nvif_async_mthd(struct nvif_async *async, struct nvif_async_req *req,
+		struct nvif_object *object, u32 mthd, void *data, u32 size)
+{
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_mthd_v0 mthd;
+	} *args;
+
+	if (!(args = kmalloc(sizeof(*args) + size, GFP_KERNEL)))
+		return -ENOMEM;
+	args->ioctl.version = 0;
+	args->ioctl.type = NVIF_IOCTL_V0_MTHD;
+	args->mthd.version = 0;
+	args->mthd.method = mthd;
+
+	return nvif_async_submit(async, req, object, args, sizeof(*args),
+				 data, size);
+}
+
+int
+nvif_async_wait(struct nvif_async *async, struct nvif_async_req *req)
+{
+	if (!nvif_async_done(req)) {
+		pthread_mutex_lock(&async->mutex);
+		while (!req->done)
+			pthread_cond_wait(&async->done, &async->mutex);
+		pthread_mutex_unlock(&async->mutex);
+	}
+	return req->ret;
+}
+
+/* waits for the worker to pick up everything submitted so far, and then
+ * for the request it's executing to complete
+ */
+void
+nvif_async_flush(struct nvif_async *async)
+{
+	struct nvif_async_req fence = {};
+	struct {
+		struct nvif_ioctl_v0 ioctl;
+		struct nvif_ioctl_nop_v0 nop;
+	} args = {
+		.ioctl.type = NVIF_IOCTL_V0_NOP,
+	};
+
+	if (!nvif_async_ioctl(async, &fence, &async->client->object,
+			      &args, sizeof(args)))
+		nvif_async_wait(async, &fence);
+}
+
+void
+nvif_async_fini(struct nvif_async *async)
+{
+	if (async->ring) {
+		pthread_mutex_lock(&async->mutex);
+		async->fini = true;
+		pthread_cond_signal(&async->work);
+		pthread_mutex_unlock(&async->mutex);
+		pthread_join(async->thread, NULL);
+
+		pthread_cond_destroy(&async->done);
+		pthread_cond_destroy(&async->space);
+		pthread_cond_destroy(&async->work);
+		pthread_mutex_destroy(&async->mutex);
+		kfree(async->ring);
+		async->ring = NULL;
+	}
+}
+
+int
+nvif_async_init(struct nvif_client *client, u32 depth,
+		struct nvif_async *async)
+{
+	int ret;
+
+	async->client = client;
+	async->depth = depth ? depth : 16;
+	async->get = 0;
+	async->put = 0;
+	async->fini = false;
+	if (!(async->ring = kcalloc(async->depth, sizeof(*async->ring),
+				    GFP_KERNEL)))
+		return -ENOMEM;
+
+	pthread_mutex_init(&async->mutex, NULL);
+	pthread_cond_init(&async->work, NULL);
+	pthread_cond_init(&async->space, NULL);
+	pthread_cond_init(&async->done, NULL);
+
+	ret = pthread_create(&async->thread, NULL, nvif_async_worker, async);
+	if (ret) {
+		pthread_cond_destroy(&async->done);
+		pthread_cond_destroy(&async->space);
+		pthread_cond_destroy(&async->work);
+		pthread_mutex_destroy(&async->mutex);
+		kfree(async->ring);
+		async->ring = NULL;
+		return -ret;
+	}
+
+	return 0;
+}
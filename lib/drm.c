@@ -43,15 +43,33 @@ struct drm_client_priv {
 	bool done;
 };
 
+/* the handle returned by NVIF_IOCTL_V0_MAP is an mmap offset on the drm
+ * fd, which need not be page-aligned, so the mapping is widened to cover
+ * the page it starts in
+ */
 static void
 drm_client_unmap(void *priv, void *ptr, u32 size)
 {
+	unsigned long offset = (unsigned long)ptr & (PAGE_SIZE - 1);
+	munmap((u8 *)ptr - offset, size + offset);
 }
 
 static void *
 drm_client_map(void *priv, u64 handle, u32 size)
 {
-	return NULL;
+	struct nvif_client *client = priv;
+	struct drm_client_priv *drm = client->object.priv;
+	u32 offset = handle & (PAGE_SIZE - 1);
+	u8 *ptr;
+
+	if (!size)
+		return NULL;
+
+	ptr = mmap(NULL, size + offset, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   drm->fd, handle - offset);
+	if (ptr == MAP_FAILED)
+		return NULL;
+	return ptr + offset;
 }
 
 static int
@@ -61,7 +79,12 @@ drm_client_ioctl(void *priv, bool super, void *data, u32 size, void **hack)
 					      DRM_COMMAND_BASE +
 					      DRM_NOUVEAU_NVIF, size);
 	struct drm_client_priv *drm = priv;
-	int ret = ioctl(drm->fd, request, data);
+	int ret;
+
+	if (size > nvif_driver_drm.ioctl_max)
+		return -E2BIG;
+
+	ret = ioctl(drm->fd, request, data);
 	if (ret < 0)
 		return -errno;
 	return ret;
@@ -211,5 +234,6 @@ nvif_driver_drm = {
 	.ioctl = drm_client_ioctl,
 	.map = drm_client_map,
 	.unmap = drm_client_unmap,
+	.ioctl_max = _IOC_SIZEMASK,
 	.keep = true,
 };
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* firmware images are mapped read-only straight from the page cache, and
+ * the mappings are shared by every request for the same name until the
+ * device list is torn down, so a process with several GPUs touches each
+ * blob once.
+ *
+ * NVOS_FIRMWARE_PATH overrides the colon-separated list of directories
+ * searched for relative names.
+ */
+#define NVOS_FIRMWARE_PATH ".:/lib/firmware/updates:/lib/firmware"
+
+struct nvos_firmware {
+	struct firmware base;
+	struct list_head head;
+	size_t mapped;
+	int refs;
+	char name[];
+};
+
+static DEFINE_MUTEX(nvos_firmware_mutex);
+static LIST_HEAD(nvos_firmware_list);
+
+static int
+nvos_firmware_open(const char *name)
+{
+	const char *path = getenv("NVOS_FIRMWARE_PATH");
+	char file[256];
+	int fd = -1;
+
+	if (name[0] == '/')
+		return open(name, O_RDONLY | O_CLOEXEC);
+
+	if (!path)
+		path = NVOS_FIRMWARE_PATH;
+
+	while (fd < 0 && *path) {
+		size_t len = strcspn(path, ":");
+		if (len && snprintf(file, sizeof(file), "%.*s/%s",
+				    (int)len, path, name) < sizeof(file))
+			fd = open(file, O_RDONLY | O_CLOEXEC);
+		path += len;
+		if (*path == ':')
+			path++;
+	}
+
+	return fd;
+}
+
+static struct nvos_firmware *
+nvos_firmware_load(const char *name)
+{
+	static const u8 empty[1];
+	struct nvos_firmware *fw;
+	struct stat st;
+	void *data = NULL;
+	int fd;
+
+	if ((fd = nvos_firmware_open(name)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+		goto done;
+
+	if (st.st_size) {
+		data = mmap(NULL, st.st_size, PROT_READ,
+			    MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (data == MAP_FAILED)
+			goto done;
+	}
+
+	if (!(fw = malloc(sizeof(*fw) + strlen(name) + 1))) {
+		if (data)
+			munmap(data, st.st_size);
+		goto done;
+	}
+
+	fw->base.size = st.st_size;
+	fw->base.data = data ? data : empty;
+	fw->mapped = data ? st.st_size : 0;
+	fw->refs = 0;
+	strcpy(fw->name, name);
+	close(fd);
+	return fw;
+
+done:
+	close(fd);
+	return NULL;
+}
+
+int
+request_firmware(const struct firmware **pfw, const char *name,
+		 struct device *dev)
+{
+	struct nvos_firmware *fw;
+
+	mutex_lock(&nvos_firmware_mutex);
+	list_for_each_entry(fw, &nvos_firmware_list, head) {
+		if (!strcmp(fw->name, name))
+			goto found;
+	}
+
+	if (!(fw = nvos_firmware_load(name))) {
+		mutex_unlock(&nvos_firmware_mutex);
+		*pfw = NULL;
+		return -ENOENT;
+	}
+	list_add(&fw->head, &nvos_firmware_list);
+
+found:
+	fw->refs++;
+	mutex_unlock(&nvos_firmware_mutex);
+	*pfw = &fw->base;
+	return 0;
+}
+
+void
+release_firmware(const struct firmware *base)
+{
+	struct nvos_firmware *fw;
+
+	if (!base)
+		return;
+
+	fw = container_of((struct firmware *)base, typeof(*fw), base);
+	mutex_lock(&nvos_firmware_mutex);
+	WARN_ON(fw->refs <= 0);
+	fw->refs--;
+	mutex_unlock(&nvos_firmware_mutex);
+}
+
+void
+os_firmware_fini(void)
+{
+	struct nvos_firmware *fw, *temp;
+
+	mutex_lock(&nvos_firmware_mutex);
+	list_for_each_entry_safe(fw, temp, &nvos_firmware_list, head) {
+		if (fw->refs)
+			continue;
+		list_del(&fw->head);
+		if (fw->mapped)
+			munmap((void *)fw->base.data, fw->mapped);
+		free(fw);
+	}
+	mutex_unlock(&nvos_firmware_mutex);
+}
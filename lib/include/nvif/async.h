@@ -0,0 +1,55 @@
+#ifndef __NVIF_ASYNC_H__
+#define __NVIF_ASYNC_H__
+#include <nvif/object.h>
+
+/* asynchronous submission of ioctls to a client.  requests are queued on
+ * a fixed-depth ring and executed in order by a worker thread, so callers
+ * can keep several in flight while doing other work.
+ *
+ * a request either has a completion callback, which is run on the worker
+ * thread once it has executed (and after which the worker won't touch it
+ * again), or it's waited on with nvif_async_wait().
+ */
+struct nvif_async_req {
+	void (*func)(struct nvif_async_req *);
+	void *priv;
+	int ret;
+
+	/* private */
+	struct nvif_object *object;
+	void *data;
+	u32 size;
+	void *args;
+	u32 skip;
+	bool done;
+};
+
+struct nvif_async {
+	struct nvif_client *client;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t space;
+	pthread_cond_t done;
+	struct nvif_async_req **ring;
+	u32 depth;
+	u32 get;
+	u32 put;
+	bool fini;
+};
+
+int  nvif_async_init(struct nvif_client *, u32 depth, struct nvif_async *);
+void nvif_async_fini(struct nvif_async *);
+int  nvif_async_ioctl(struct nvif_async *, struct nvif_async_req *,
+		      struct nvif_object *, void *, u32);
+int  nvif_async_mthd(struct nvif_async *, struct nvif_async_req *,
+		     struct nvif_object *, u32 mthd, void *, u32);
+int  nvif_async_wait(struct nvif_async *, struct nvif_async_req *);
+void nvif_async_flush(struct nvif_async *);
+
+static inline bool
+nvif_async_done(struct nvif_async_req *req)
+{
+	return __atomic_load_n(&req->done, __ATOMIC_ACQUIRE);
+}
+#endif
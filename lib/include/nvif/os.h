@@ -71,6 +71,7 @@ typedef dma_addr_t resource_size_t;
 #define clamp(a,b,c) min(max((a), (b)), (c))
 #define roundup(a,b) ((((a) + ((b) - 1)) / (b)) * (b))
 #define round_up(a,b) roundup((a), (b))
+#define ALIGN(a,b) round_up((a), (b))
 #define rounddown(a,b) ((a) / (b) * (b))
 #define upper_32_bits(a) ((a) >> 32)
 #define lower_32_bits(a) ((a) & 0xffffffff)
@@ -89,6 +90,12 @@ typedef dma_addr_t resource_size_t;
 #define div_u64(a,b) (a) / (b)
 #define likely(a) (a)
 #define unlikely(a) (a)
+#define READ_ONCE(a) (*(volatile typeof(a) *)&(a))
+#define WRITE_ONCE(a,b) (*(volatile typeof(a) *)&(a) = (b))
+#define smp_mb() __sync_synchronize()
+#define smp_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define smp_store_release(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define cmpxchg(p,o,n) __sync_val_compare_and_swap((p), (o), (n))
 #define BIT(a) (1UL << (a))
 
 #define ERR_PTR(err) ((void *)(long)(err))
@@ -99,15 +106,6 @@ typedef dma_addr_t resource_size_t;
 	(!_ptr || IS_ERR(_ptr));                                               \
 })
 
-#define jiffies (ktime_to_ns(ktime_get()))
-#define nsecs_to_jiffies(a) (a)
-#define usecs_to_jiffies(a) nsecs_to_jiffies((a) * 1000)
-#define msecs_to_jiffies(a) usecs_to_jiffies((a) * 1000)
-#define HZ 1000000
-
-#define time_before(a,b) ((a) < (b))
-#define time_after_eq(a,b) ((a) >= (b))
-
 #define THIS_MODULE 0
 #define request_module(a,b,c)
 
@@ -153,6 +151,22 @@ order_base_2(u64 base)
 	return (base & (base - 1)) ? log2 + 1: log2;
 }
 
+#define GOLDEN_RATIO_32 0x61C88647
+
+static inline u32
+hash_32(u32 val, unsigned int bits)
+{
+	return (val * GOLDEN_RATIO_32) >> (32 - bits);
+}
+
+#define GOLDEN_RATIO_64 0x61C8864680B583EBULL
+
+static inline u32
+hash_64(u64 val, unsigned int bits)
+{
+	return (val * GOLDEN_RATIO_64) >> (64 - bits);
+}
+
 /******************************************************************************
  * errno
  *****************************************************************************/
@@ -335,28 +349,78 @@ typedef struct atomic {
  *****************************************************************************/
 #include <time.h>
 
-typedef struct timespec ktime_t;
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC  1000000000L
+#define USEC_PER_SEC  1000000L
+#define MSEC_PER_SEC  1000L
+
+typedef s64 ktime_t;
+
+static inline s64
+nvos_clock(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
 
 static inline ktime_t
 ktime_get(void)
 {
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return ts;
+	return nvos_clock(CLOCK_MONOTONIC);
 }
 
 static inline s64
 ktime_to_ns(ktime_t kt)
 {
-	return (s64)kt.tv_sec * 1000000000 + kt.tv_nsec;
+	return kt;
 }
 
 static inline s64
 ktime_to_us(ktime_t kt)
 {
-	return ktime_to_ns(kt) / 1000;
+	return kt / NSEC_PER_USEC;
+}
+
+/* jiffies come from the same monotonic clock as ktime, which is read via
+ * the vDSO without a syscall, so timeout loops can poll it freely.  the
+ * coarse clock would be cheaper still, but it only advances once per
+ * kernel tick (up to 10ms), which is longer than a jiffy here and would
+ * let short time_after() timeouts expire early.
+ */
+#define HZ 1000
+
+#define jiffies ((unsigned long)(nvos_clock(CLOCK_MONOTONIC) /                 \
+				 (NSEC_PER_SEC / HZ)))
+
+static inline unsigned long
+nsecs_to_jiffies(u64 n)
+{
+	return DIV_ROUND_UP(n, NSEC_PER_SEC / HZ);
+}
+
+static inline unsigned long
+usecs_to_jiffies(u64 u)
+{
+	return DIV_ROUND_UP(u, USEC_PER_SEC / HZ);
 }
 
+static inline unsigned long
+msecs_to_jiffies(u64 m)
+{
+	return DIV_ROUND_UP(m, MSEC_PER_SEC / HZ);
+}
+
+#define jiffies_to_nsecs(a) ((u64)(a) * (NSEC_PER_SEC / HZ))
+#define jiffies_to_usecs(a) ((u64)(a) * (USEC_PER_SEC / HZ))
+#define jiffies_to_msecs(a) ((u64)(a) * (MSEC_PER_SEC / HZ))
+
+#define time_after(a,b) ((long)((b) - (a)) < 0)
+#define time_before(a,b) time_after((b), (a))
+#define time_after_eq(a,b) ((long)((a) - (b)) >= 0)
+#define time_before_eq(a,b) time_after_eq((b), (a))
+
 /******************************************************************************
  * krefs
  *****************************************************************************/
@@ -429,11 +493,28 @@ typedef unsigned gfp_t;
 #define kmalloc(a,b) malloc((a))
 #define kzalloc(a,b) calloc(1, (a))
 #define kcalloc(a,b,c) calloc((a), (b))
+#define krealloc(a,b,c) realloc((a), (b))
 #define kfree free
 
 #define vzalloc(a) calloc(1, (a))
 #define vfree free
 
+#define SLAB_HWCACHE_ALIGN 0x00002000UL
+
+struct kmem_cache;
+
+struct kmem_cache *kmem_cache_create(const char *, size_t size, size_t align,
+				     unsigned long flags, void (*)(void *));
+void  kmem_cache_destroy(struct kmem_cache *);
+void *kmem_cache_alloc(struct kmem_cache *, gfp_t);
+void  kmem_cache_free(struct kmem_cache *, void *);
+
+static inline void *
+kmem_cache_zalloc(struct kmem_cache *cache, gfp_t gfp)
+{
+	return kmem_cache_alloc(cache, gfp | __GFP_ZERO);
+}
+
 static inline void *
 kmemdup(const void *src, size_t len, gfp_t gfp)
 {
@@ -579,30 +660,115 @@ extern void os_intr_free(unsigned int, void *);
 #define free_irq os_intr_free
 
 /******************************************************************************
- * spinlocks - using pthread mutex due to no static spinlock initialiser
+ * spinlocks
  *****************************************************************************/
 #include <pthread.h>
 
+#if defined(CONFIG_NVOS_SPINLOCK_MUTEX)
+/* plain pthread mutex, selected with SPINLOCK=mutex */
 typedef struct spinlock_t {
 	pthread_mutex_t lock;
+#if defined(CONFIG_NVOS_LOCKDEP)
+	pthread_t holder;
+	bool held;
+#endif
 } spinlock_t;
 
 #define DEFINE_SPINLOCK(a) spinlock_t a = { .lock = PTHREAD_MUTEX_INITIALIZER }
 
 #define spin_lock_init(a) do {                                                 \
-	(a)->lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;                \
+	*(a) = (spinlock_t) { .lock = PTHREAD_MUTEX_INITIALIZER };             \
 } while(0)
-#define spin_lock(a) pthread_mutex_lock(&(a)->lock)
-#define spin_unlock(a) pthread_mutex_unlock(&(a)->lock)
+#else
+/* futex lock: 0 = unlocked, 1 = locked, 2 = locked with sleeping waiters,
+ * contended lockers spin for a while before sleeping
+ */
+typedef struct spinlock_t {
+	u32 value;
+#if defined(CONFIG_NVOS_LOCKDEP)
+	pthread_t holder;
+	bool held;
+#endif
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(a) spinlock_t a = {}
+
+#define spin_lock_init(a) (*(a) = (spinlock_t) {})
+
+void nvos_spin_lock_slow(spinlock_t *);
+void nvos_spin_unlock_wake(spinlock_t *);
+#endif
+
+#if defined(CONFIG_NVOS_LOCKDEP)
+void nvos_lockdep_acquire(spinlock_t *);
+void nvos_lockdep_acquired(spinlock_t *);
+void nvos_lockdep_release(spinlock_t *);
+bool nvos_lockdep_held(spinlock_t *);
+#else
+#define nvos_lockdep_acquire(a) (void)(a)
+#define nvos_lockdep_acquired(a) (void)(a)
+#define nvos_lockdep_release(a) (void)(a)
+#endif
+
+#if defined(CONFIG_NVOS_SPINLOCK_MUTEX)
+static inline void
+spin_lock(spinlock_t *lock)
+{
+	nvos_lockdep_acquire(lock);
+	pthread_mutex_lock(&lock->lock);
+	nvos_lockdep_acquired(lock);
+}
+
+static inline void
+spin_unlock(spinlock_t *lock)
+{
+	nvos_lockdep_release(lock);
+	pthread_mutex_unlock(&lock->lock);
+}
+
+static inline bool
+spin_is_locked(spinlock_t *lock)
+{
+	if (pthread_mutex_trylock(&lock->lock))
+		return true;
+	pthread_mutex_unlock(&lock->lock);
+	return false;
+}
+#else
+static inline void
+spin_lock(spinlock_t *lock)
+{
+	u32 value = 0;
+	nvos_lockdep_acquire(lock);
+	if (!__atomic_compare_exchange_n(&lock->value, &value, 1, false,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		nvos_spin_lock_slow(lock);
+	nvos_lockdep_acquired(lock);
+}
+
+static inline void
+spin_unlock(spinlock_t *lock)
+{
+	nvos_lockdep_release(lock);
+	if (__atomic_exchange_n(&lock->value, 0, __ATOMIC_RELEASE) == 2)
+		nvos_spin_unlock_wake(lock);
+}
+
+static inline bool
+spin_is_locked(spinlock_t *lock)
+{
+	return __atomic_load_n(&lock->value, __ATOMIC_RELAXED) != 0;
+}
+#endif
+
+#if defined(CONFIG_NVOS_LOCKDEP)
+#define assert_spin_locked(a) BUG_ON(!nvos_lockdep_held(a))
+#else
+#define assert_spin_locked(a) BUG_ON(!spin_is_locked(a))
+#endif
+
 #define spin_lock_irqsave(a,b) do { (b) = 1; spin_lock((a)); } while (0)
 #define spin_unlock_irqrestore(a,b) do { (void)(b); spin_unlock((a)); } while (0)
-#define spin_is_locked(a) ({ \
-	int _ret = pthread_mutex_trylock(&(a)->lock) != 0; \
-	if (_ret == 0) \
-		pthread_mutex_unlock(&(a)->lock); \
-	_ret; \
-})
-#define assert_spin_locked(a) BUG_ON(!spin_is_locked(a))
 
 /******************************************************************************
  * rwlocks
@@ -645,6 +811,67 @@ struct lock_class_key {
  *****************************************************************************/
 #include "list.h"
 
+static inline void
+list_add_tail_rcu(struct list_head *entry, struct list_head *head)
+{
+	struct list_head *prev = head->prev;
+	entry->next = head;
+	entry->prev = prev;
+	smp_store_release(&prev->next, entry);
+	head->prev = entry;
+}
+
+/* ->next is left intact, a reader may still be sitting on the entry */
+static inline void
+list_del_rcu(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	WRITE_ONCE(entry->prev->next, entry->next);
+}
+
+#define list_for_each_entry_rcu(pos, head, member)                             \
+	for (pos = __container_of(smp_load_acquire(&(head)->next), pos, member);\
+	     &pos->member != (head);                                           \
+	     pos = __container_of(smp_load_acquire(&pos->member.next), pos,    \
+				  member))
+
+/******************************************************************************
+ * rcu
+ *****************************************************************************/
+/* readers count themselves in by bumping one of two counters, chosen by
+ * the parity of the grace period they started in.  synchronize_rcu()
+ * advances the grace period twice, waiting each time for the counter of
+ * the parity it left to drain, which covers every reader that could have
+ * seen the state from before it was called.
+ */
+extern long nvos_rcu_count[2];
+extern u32  nvos_rcu_gp;
+extern __thread int nvos_rcu_nest;
+extern __thread int nvos_rcu_idx;
+
+static inline void
+rcu_read_lock(void)
+{
+	if (nvos_rcu_nest++ == 0) {
+		nvos_rcu_idx = __atomic_load_n(&nvos_rcu_gp,
+					       __ATOMIC_RELAXED) & 1;
+		__atomic_fetch_add(&nvos_rcu_count[nvos_rcu_idx], 1,
+				   __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+static inline void
+rcu_read_unlock(void)
+{
+	if (--nvos_rcu_nest == 0) {
+		__atomic_fetch_sub(&nvos_rcu_count[nvos_rcu_idx], 1,
+				   __ATOMIC_RELEASE);
+	}
+}
+
+void synchronize_rcu(void);
+
 /******************************************************************************
  * rbtree
  *****************************************************************************/
@@ -654,10 +881,14 @@ struct rb_root {
 
 #define RB_ROOT (struct rb_root) {}
 
+#define RB_RED   0
+#define RB_BLACK 1
+
 struct rb_node {
 	struct rb_node *parent;
 	struct rb_node *rb_left;
 	struct rb_node *rb_right;
+	int rb_color;
 };
 
 #define RB_EMPTY_NODE(a) ((a)->parent == (a))
@@ -695,6 +926,14 @@ void  nvos_iounmap(void __iomem *ptr);
 #define memcpy_toio memcpy
 #define wmb()
 
+static inline void
+cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
 static inline int
 arch_phys_wc_add(u64 base, u64 size)
 {
@@ -1190,82 +1429,138 @@ struct sg_table {
 
 struct firmware {
 	size_t size;
-	void *data;
+	const u8 *data;
 };
 
-static inline int
-request_firmware(const struct firmware **pfw, const char *name,
-		 struct device *dev)
-{
-	struct firmware *fw = *(void **)pfw = malloc(sizeof(*fw));
-	int fd = open(name, O_RDONLY);
-	if (fd >= 0) {
-		off_t len = lseek(fd, 0, SEEK_END);
-		fw->data = malloc(len);
-		fw->size = pread(fd, fw->data, len, 0);
-		return 0;
-	}
-	free(fw);
-	return -EINVAL;
-}
-
-static inline void
-release_firmware(const struct firmware *fw)
-{
-	free(fw->data);
-	free((void *)fw);
-}
+int  request_firmware(const struct firmware **, const char *name,
+		      struct device *);
+void release_firmware(const struct firmware *);
 
 /******************************************************************************
  * workqueues
  *****************************************************************************/
 struct work_struct {
-	union {
-		void (*func)(struct work_struct *);
-		void (*exec)(void *);
-	};
-	struct nvos_work *nvos;
+	void (*func)(struct work_struct *);
+	struct work_struct *next;
+	unsigned long flags;
 };
 
-#define INIT_WORK(a,b) ((a)->func = (b), (a)->nvos = NULL)
-#define schedule_work(a) BUG_ON(!nvos_work_init((a)->exec, (a), &(a)->nvos))
-#define flush_work(a) nvos_work_fini(&(a)->nvos)
+#define INIT_WORK(a,b) ((a)->func = (b), (a)->next = NULL, (a)->flags = 0)
+#define schedule_work(a) nvos_work_queue((a))
+#define flush_work(a) nvos_work_flush((a))
 
-bool nvos_work_init(void (*)(void *), void *, struct nvos_work **);
-void nvos_work_fini(struct nvos_work **);
+bool nvos_work_queue(struct work_struct *);
+bool nvos_work_flush(struct work_struct *);
 
 /******************************************************************************
  * waitqueues
  *****************************************************************************/
 typedef struct __wait_queue_head {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	u32 seq;
 } wait_queue_head_t;
 
-#define init_waitqueue_head(wq) (void)(wq)
-#define wake_up(wq) (void)(wq)
-#define wake_up_all(wq) (void)(wq)
+static inline void
+init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&wq->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&wq->mutex, NULL);
+	wq->seq = 0;
+}
+
+static inline void
+__wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->mutex);
+	wq->seq++;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->mutex);
+}
+
+#define wake_up(wq) __wake_up((wq))
+#define wake_up_all(wq) __wake_up((wq))
+
+/* the condition is evaluated outside the waitqueue's lock, a sleeper
+ * samples the wakeup sequence number beforehand and only blocks if no
+ * wake_up() has happened since, so none can be missed
+ */
+static inline u32
+__wait_event_seq(wait_queue_head_t *wq)
+{
+	return __atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE);
+}
+
+static inline bool
+__wait_event_sleep(wait_queue_head_t *wq, u32 seq, const struct timespec *end)
+{
+	bool ret = true;
+	pthread_mutex_lock(&wq->mutex);
+	while (ret && wq->seq == seq) {
+		if (end)
+			ret = pthread_cond_timedwait(&wq->cond, &wq->mutex,
+						     end) != ETIMEDOUT;
+		else
+			pthread_cond_wait(&wq->cond, &wq->mutex);
+	}
+	pthread_mutex_unlock(&wq->mutex);
+	return ret;
+}
+
+static inline struct timespec
+__wait_event_deadline(unsigned long timeout)
+{
+	s64 end = ktime_to_ns(ktime_get()) + jiffies_to_nsecs(timeout);
+	return (struct timespec) {
+		.tv_sec = end / NSEC_PER_SEC,
+		.tv_nsec = end % NSEC_PER_SEC,
+	};
+}
+
+static inline long
+__wait_event_remaining(const struct timespec *end)
+{
+	s64 left = ((s64)end->tv_sec * NSEC_PER_SEC + end->tv_nsec) -
+		   ktime_to_ns(ktime_get());
+	return max_t(long, left > 0 ? nsecs_to_jiffies(left) : 0, 1);
+}
 
 #define wait_event(wq,cond) do {                                               \
-	(void)(wq);                                                            \
-	usleep(1);                                                             \
-} while (!(cond))
+	wait_queue_head_t *_wq = &(wq);                                        \
+	u32 _seq;                                                              \
+	while (_seq = __wait_event_seq(_wq), !(cond))                          \
+		__wait_event_sleep(_wq, _seq, NULL);                           \
+} while (0)
 
 #define wait_event_interruptible(wq,cond) ({                                   \
 	wait_event((wq), (cond)); 0;                                           \
 })
 
-#define wait_event_timeout(wq,cond,jiffies) ({                                 \
-	unsigned long _t = (jiffies) / 10000;                                  \
-	(void)(wq);                                                            \
-	do {                                                                   \
-		if (cond)                                                      \
+#define wait_event_timeout(wq,cond,timeout) ({                                 \
+	wait_queue_head_t *_wq = &(wq);                                        \
+	struct timespec _end = __wait_event_deadline((timeout));               \
+	long _ret;                                                             \
+	u32 _seq;                                                              \
+	while (1) {                                                            \
+		_seq = __wait_event_seq(_wq);                                  \
+		if (cond) {                                                    \
+			_ret = __wait_event_remaining(&_end);                  \
 			break;                                                 \
-		usleep(10);                                                    \
-	} while (--_t > 0);                                                    \
-	_t;                                                                    \
+		}                                                              \
+		if (!__wait_event_sleep(_wq, _seq, &_end)) {                   \
+			_ret = !!(cond);                                       \
+			break;                                                 \
+		}                                                              \
+	}                                                                      \
+	_ret;                                                                  \
 })
 
-#define wait_event_interruptible_timeout(wq,cond,jiffies)                      \
-	wait_event_timeout((wq), (cond), (jiffies))
+#define wait_event_interruptible_timeout(wq,cond,timeout)                      \
+	wait_event_timeout((wq), (cond), (timeout))
 
 /******************************************************************************
  * i2c
@@ -1392,10 +1687,14 @@ extern const struct i2c_algorithm i2c_bit_algo;
  *****************************************************************************/
 #include <unistd.h>
 
-#define udelay(a) usleep((a))
-#define mdelay(a) usleep((a) * 1000)
-#define msleep(a) usleep((a) * 1000)
-#define usleep_range(a,b) usleep((a))
+void nvos_ndelay(u64 nsecs);
+void nvos_nsleep(u64 nsecs);
+
+#define ndelay(a) nvos_ndelay((a))
+#define udelay(a) nvos_ndelay((u64)(a) * NSEC_PER_USEC)
+#define mdelay(a) nvos_ndelay((u64)(a) * NSEC_PER_MSEC)
+#define msleep(a) nvos_nsleep((u64)(a) * NSEC_PER_MSEC)
+#define usleep_range(a,b) nvos_nsleep((u64)(a) * NSEC_PER_USEC)
 
 /******************************************************************************
  * reboot
@@ -21,61 +21,217 @@
  *
  * Authors: Ben Skeggs
  */
+#define _GNU_SOURCE
 
 #include <core/device.h>
 #include <core/client.h>
 #include "priv.h"
 
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+/* bounds for the adaptive poll used when there's no interrupt source to
+ * block on, the interval doubles each time the handler finds nothing to
+ * do and drops back to the minimum as soon as it handles something
+ */
+#define OS_INTR_POLL_MIN  20000ULL /* ns */
+#define OS_INTR_POLL_MAX  10000000ULL /* ns */
+
 struct os_intr {
 	struct list_head head;
 	pthread_t thread;
 	irq_handler_t handler;
 	int irq;
 	void *dev;
+	int uio;
+	int event;
+	bool done;
 };
 static DEFINE_MUTEX(os_intr_mutex);
 static LIST_HEAD(os_intr_list);
 
+/******************************************************************************
+ * UIO, used when the device has been bound to uio_pci_generic
+ *****************************************************************************/
+static int
+os_intr_uio_open(int irq)
+{
+	struct dirent *dirent;
+	char path[128];
+	int fd = -1, line;
+	FILE *file;
+	DIR *dir;
+
+	if (irq <= 0 || !(dir = opendir("/sys/class/uio")))
+		return -1;
+
+	while (fd < 0 && (dirent = readdir(dir))) {
+		if (strncmp(dirent->d_name, "uio", 3))
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/class/uio/%.32s/device/irq",
+			 dirent->d_name);
+		if (!(file = fopen(path, "r")))
+			continue;
+		if (fscanf(file, "%d", &line) != 1)
+			line = -1;
+		fclose(file);
+
+		if (line == irq) {
+			snprintf(path, sizeof(path), "/dev/%.32s", dirent->d_name);
+			fd = open(path, O_RDWR | O_CLOEXEC);
+		}
+	}
+
+	closedir(dir);
+	return fd;
+}
+
+static void
+os_intr_uio_unmask(struct os_intr *intr)
+{
+	const u32 enable = 1;
+	if (write(intr->uio, &enable, sizeof(enable)) != sizeof(enable))
+		fprintf(stderr, "uio irq %d unmask failed, %d\n", intr->irq, errno);
+}
+
+/******************************************************************************
+ * interrupt thread
+ *****************************************************************************/
 static void *
 os_intr(void *arg)
 {
 	struct os_intr *intr = arg;
+	struct pollfd fds[2] = {
+		{ .fd = intr->event, .events = POLLIN },
+		{ .fd = intr->uio, .events = POLLIN },
+	};
+	int nfds = intr->uio >= 0 ? 2 : 1;
+	u64 delay = OS_INTR_POLL_MIN;
+	u64 data;
+	u32 count;
+
+	if (intr->uio >= 0)
+		os_intr_uio_unmask(intr);
+
 	while (1) {
-		intr->handler(intr->irq, intr->dev);
-		usleep(10000);
+		struct timespec timeout = {
+			.tv_sec = delay / 1000000000ULL,
+			.tv_nsec = delay % 1000000000ULL,
+		};
+
+		if (ppoll(fds, nfds, intr->uio >= 0 ? NULL : &timeout,
+			  NULL) < 0 && errno != EINTR)
+			break;
+
+		if (fds[0].revents & POLLIN) {
+			if (read(intr->event, &data, sizeof(data)) < 0)
+				break;
+		}
+
+		if (READ_ONCE(intr->done))
+			break;
+
+		if (fds[1].revents & POLLIN) {
+			if (read(intr->uio, &count, sizeof(count)) < 0)
+				break;
+		}
+
+		if (intr->handler(intr->irq, intr->dev) == IRQ_HANDLED)
+			delay = OS_INTR_POLL_MIN;
+		else
+			delay = min(delay * 2, OS_INTR_POLL_MAX);
+
+		if (fds[1].revents & POLLIN)
+			os_intr_uio_unmask(intr);
 	}
+
 	return NULL;
 }
 
+/* wakes the handlers registered on a line (all of them, or only dev's),
+ * returns how many were woken
+ */
+int
+os_intr_trigger(unsigned int irq, void *dev)
+{
+	const u64 data = 1;
+	struct os_intr *intr;
+	int count = 0;
+
+	mutex_lock(&os_intr_mutex);
+	list_for_each_entry(intr, &os_intr_list, head) {
+		if (intr->irq == irq && (!dev || intr->dev == dev)) {
+			if (write(intr->event, &data, sizeof(data)) < 0)
+				fprintf(stderr, "irq %d trigger failed, %d\n",
+					irq, errno);
+			else
+				count++;
+		}
+	}
+	mutex_unlock(&os_intr_mutex);
+	return count;
+}
+
 int
 os_intr_init(unsigned int irq, irq_handler_t handler, unsigned long flags,
 	     const char *name, void *dev)
 {
 	struct os_intr *intr = malloc(sizeof(*intr));
+	int ret;
+
 	if (!intr)
 		return -ENOMEM;
 	intr->handler = handler;
 	intr->irq = irq;
 	intr->dev = dev;
+	intr->done = false;
+
+	intr->event = eventfd(0, EFD_CLOEXEC);
+	if (intr->event < 0) {
+		ret = -errno;
+		free(intr);
+		return ret;
+	}
+
+	intr->uio = os_intr_uio_open(irq);
+
+	ret = pthread_create(&intr->thread, NULL, os_intr, intr);
+	if (ret) {
+		if (intr->uio >= 0)
+			close(intr->uio);
+		close(intr->event);
+		free(intr);
+		return -ret;
+	}
+
 	mutex_lock(&os_intr_mutex);
 	list_add(&intr->head, &os_intr_list);
 	mutex_unlock(&os_intr_mutex);
-	pthread_create(&intr->thread, NULL, os_intr, intr);
 	return 0;
 }
 
 void
 os_intr_free(unsigned int irq, void *dev)
 {
+	const u64 data = 1;
 	struct os_intr *intr;
 
 	mutex_lock(&os_intr_mutex);
 	list_for_each_entry(intr, &os_intr_list, head) {
 		if (intr->irq == irq && intr->dev == dev) {
-			pthread_cancel(intr->thread);
-			pthread_join(intr->thread, NULL);
 			list_del(&intr->head);
 			mutex_unlock(&os_intr_mutex);
+
+			WRITE_ONCE(intr->done, true);
+			if (write(intr->event, &data, sizeof(data)) < 0)
+				pthread_cancel(intr->thread);
+			pthread_join(intr->thread, NULL);
+
+			if (intr->uio >= 0)
+				close(intr->uio);
+			close(intr->event);
 			free(intr);
 			return;
 		}
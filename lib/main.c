@@ -22,6 +22,8 @@
  * Authors: Ben Skeggs
  */
 
+#include <sys/mman.h>
+
 #include <nvif/client.h>
 #include <nvif/driver.h>
 #include <nvif/notify.h>
@@ -32,6 +34,7 @@
 #include <core/pci.h>
 #include <core/ioctl.h>
 #include <core/event.h>
+#include <core/option.h>
 
 #include "priv.h"
 
@@ -46,90 +49,217 @@ u64  os_device_subdev = ~0ULL;
 /******************************************************************************
  * horrific stuff to implement linux's ioremap interface on top of pciaccess
  *****************************************************************************/
+/* each device's BARs are registered in a hash keyed by base address as the
+ * device is created.  PCI BARs are naturally aligned, so the BAR containing
+ * an address is found by masking the address with each distinct BAR size
+ * in use and probing the hash.  BARs are mapped on first use and shared
+ * between all ioremap()s that hit them, each pointer handed out is tracked
+ * in a second hash so iounmap() can find its BAR directly.
+ */
+#define OS_IOREMAP_BITS 6
+
+struct os_ioremap {
+	struct os_ioremap *next;
+	struct os_ioremap_bar *bar;
+	void __iomem *ptr;
+	int refs;
+};
+
 static DEFINE_MUTEX(os_ioremap_mutex);
-static struct os_ioremap_info {
-       struct pci_device *pdev;
-       int refs;
-       u64 addr;
-       u64 size;
-       void *ptr;
-} os_ioremap[32];
+static struct os_ioremap_bar *os_ioremap_bar[1 << OS_IOREMAP_BITS];
+static struct os_ioremap *os_ioremap_ptr[1 << OS_IOREMAP_BITS];
+static u64 os_ioremap_sizes;
 
-void __iomem *
-nvos_ioremap_bar(struct pci_device *pdev, int bar, u64 addr)
+static inline u32
+os_ioremap_hash(u64 key)
+{
+	return (key * 0x9e37fffffffc0001ULL) >> (64 - OS_IOREMAP_BITS);
+}
+
+static struct os_ioremap_bar *
+os_ioremap_bar_find(u64 addr, u64 size)
+{
+	struct os_ioremap_bar *bar;
+	u64 sizes = os_ioremap_sizes;
+
+	while (sizes) {
+		int order = __ffs64(sizes);
+		u64 base = addr & ~((1ULL << order) - 1);
+		sizes &= sizes - 1;
+
+		bar = os_ioremap_bar[os_ioremap_hash(base)];
+		for (; bar; bar = bar->next) {
+			if (addr        >= bar->addr &&
+			    addr + size <= bar->addr + bar->size)
+				return bar;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+os_ioremap_bar_init(struct os_device *odev)
 {
-	u64 base = pdev->regions[bar].base_addr;
-	u64 size = pdev->regions[bar].size;
-	u64 offset = addr - base;
-	void __iomem *ptr = NULL;
+	struct pci_device *pdev = odev->pdev.pdev;
 	int i;
 
 	mutex_lock(&os_ioremap_mutex);
-	for (i = 0; !ptr && i < ARRAY_SIZE(os_ioremap); i++) {
-		if (os_ioremap[i].refs && os_ioremap[i].addr == base) {
-			os_ioremap[i].refs++;
-			ptr = os_ioremap[i].ptr + offset;
-		}
+	for (i = 0; i < ARRAY_SIZE(odev->bar); i++) {
+		struct os_ioremap_bar *bar = &odev->bar[i];
+		u32 hash;
+
+		bar->pdev = pdev;
+		bar->addr = pdev->regions[i].base_addr;
+		bar->size = pdev->regions[i].size;
+		if (!bar->size || !is_power_of_2(bar->size) ||
+		    (bar->addr & (bar->size - 1)))
+			continue;
+
+		hash = os_ioremap_hash(bar->addr);
+		bar->next = os_ioremap_bar[hash];
+		os_ioremap_bar[hash] = bar;
+		os_ioremap_sizes |= bar->size;
 	}
+	mutex_unlock(&os_ioremap_mutex);
+}
+
+static void
+os_ioremap_bar_fini(struct os_device *odev)
+{
+	struct os_ioremap_bar **pbar, *bar;
+	int i;
 
-	for (i = 0; !ptr && i < ARRAY_SIZE(os_ioremap); i++) {
-		if (!os_ioremap[i].refs &&
-		    !pci_device_map_range(pdev, base, size,
-					  PCI_DEV_MAP_FLAG_WRITABLE,
-					  &os_ioremap[i].ptr)) {
-			os_ioremap[i].pdev = pdev;
-			os_ioremap[i].refs = 1;
-			os_ioremap[i].addr = base;
-			os_ioremap[i].size = size;
-			ptr = os_ioremap[i].ptr + offset;
+	mutex_lock(&os_ioremap_mutex);
+	for (i = 0; i < ARRAY_SIZE(odev->bar); i++) {
+		pbar = &os_ioremap_bar[os_ioremap_hash(odev->bar[i].addr)];
+		while ((bar = *pbar)) {
+			if (bar == &odev->bar[i]) {
+				WARN_ON(bar->refs);
+				*pbar = bar->next;
+				break;
+			}
+			pbar = &bar->next;
 		}
 	}
-	mutex_unlock(&os_ioremap_mutex);
 
-	return ptr;
+	os_ioremap_sizes = 0;
+	for (i = 0; i < ARRAY_SIZE(os_ioremap_bar); i++) {
+		for (bar = os_ioremap_bar[i]; bar; bar = bar->next)
+			os_ioremap_sizes |= bar->size;
+	}
+	mutex_unlock(&os_ioremap_mutex);
 }
 
 void __iomem *
 nvos_ioremap(u64 addr, u64 size)
 {
-	struct os_device *odev;
-	int i;
+	struct os_ioremap_bar *bar;
+	struct os_ioremap *map;
+	void __iomem *ptr;
+	u32 hash;
 
-	list_for_each_entry(odev, &os_device_list, head) {
-		struct pci_device *pdev = odev->pdev.pdev;
-		for (i = 0; i < ARRAY_SIZE(pdev->regions); i++) {
-			if (addr        >= pdev->regions[i].base_addr &&
-			    addr + size <= pdev->regions[i].base_addr +
-					   pdev->regions[i].size) {
-				return nvos_ioremap_bar(pdev, i, addr);
-			}
+	mutex_lock(&os_ioremap_mutex);
+	if (!(bar = os_ioremap_bar_find(addr, size)))
+		goto fail;
+
+	if (!bar->refs) {
+		if (pci_device_map_range(bar->pdev, bar->addr, bar->size,
+					 PCI_DEV_MAP_FLAG_WRITABLE, &bar->ptr))
+			goto fail;
+	}
+
+	ptr = bar->ptr + (addr - bar->addr);
+	hash = os_ioremap_hash((unsigned long)ptr);
+	for (map = os_ioremap_ptr[hash]; map; map = map->next) {
+		if (map->ptr == ptr)
+			break;
+	}
+
+	if (!map) {
+		if (!(map = malloc(sizeof(*map)))) {
+			if (!bar->refs)
+				pci_device_unmap_range(bar->pdev, bar->ptr,
+						       bar->size);
+			goto fail;
 		}
+		map->bar = bar;
+		map->ptr = ptr;
+		map->refs = 0;
+		map->next = os_ioremap_ptr[hash];
+		os_ioremap_ptr[hash] = map;
 	}
 
+	map->refs++;
+	bar->refs++;
+	mutex_unlock(&os_ioremap_mutex);
+	return ptr;
+
+fail:
+	mutex_unlock(&os_ioremap_mutex);
 	return NULL;
 }
 
 void
 nvos_iounmap(void __iomem *ptr)
 {
-	int i;
+	struct os_ioremap **pmap, *map;
+	struct os_ioremap_bar *bar;
+
+	if (!ptr)
+		return;
 
 	mutex_lock(&os_ioremap_mutex);
-	for (i = 0; ptr && i < ARRAY_SIZE(os_ioremap); i++) {
-		if (os_ioremap[i].refs &&
-		    ptr >= os_ioremap[i].ptr &&
-		    ptr <  os_ioremap[i].ptr + os_ioremap[i].size) {
-			if (!--os_ioremap[i].refs) {
-				pci_device_unmap_range(os_ioremap[i].pdev,
-						       os_ioremap[i].ptr,
-						       os_ioremap[i].size);
-			}
-			break;
+	pmap = &os_ioremap_ptr[os_ioremap_hash((unsigned long)ptr)];
+	while ((map = *pmap) && map->ptr != ptr)
+		pmap = &map->next;
+
+	if (!WARN_ON(!map)) {
+		bar = map->bar;
+		if (!--map->refs) {
+			*pmap = map->next;
+			free(map);
 		}
+
+		if (!--bar->refs)
+			pci_device_unmap_range(bar->pdev, bar->ptr, bar->size);
 	}
 	mutex_unlock(&os_ioremap_mutex);
 }
 
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+/* registers a BAR backed by ordinary memory rather than a device, for the
+ * null driver to replay register traces against.  the BAR starts out with
+ * a reference held, so it's never handed to pciaccess to map or unmap
+ */
+int
+os_ioremap_ram(struct os_ioremap_bar *bar, u64 addr, u64 size)
+{
+	u32 hash;
+
+	if (!is_power_of_2(size) || (addr & (size - 1)))
+		return -EINVAL;
+
+	bar->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE |
+			MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (bar->ptr == MAP_FAILED)
+		return -ENOMEM;
+
+	bar->pdev = NULL;
+	bar->addr = addr;
+	bar->size = size;
+	bar->refs = 1;
+
+	mutex_lock(&os_ioremap_mutex);
+	hash = os_ioremap_hash(bar->addr);
+	bar->next = os_ioremap_bar[hash];
+	os_ioremap_bar[hash] = bar;
+	os_ioremap_sizes |= bar->size;
+	mutex_unlock(&os_ioremap_mutex);
+	return 0;
+}
+#endif
+
 /******************************************************************************
  * client interfaces
  *****************************************************************************/
@@ -137,12 +267,14 @@ static void
 os_fini_device(struct os_device *odev)
 {
 	nvkm_device_del(&odev->device);
+	os_ioremap_bar_fini(odev);
 	list_del(&odev->head);
 	kfree(odev);
 }
 
 static int
-os_init_device(struct pci_device *pdev, const char *cfg, const char *dbg)
+os_init_device(struct pci_device *pdev, const char *cfg, const char *dbg,
+	       struct os_device **podev)
 {
 	struct os_device *odev;
 	int ret;
@@ -169,26 +301,59 @@ os_init_device(struct pci_device *pdev, const char *cfg, const char *dbg)
 	odev->pdev._bus.number = pdev->bus;
 	odev->pdev.bus = &odev->pdev._bus;
 	odev->pdev.devfn = PCI_DEVFN(pdev->dev, pdev->func);
-	list_add_tail(&odev->head, &os_device_list);
+	odev->pdev.irq = pdev->irq;
+	os_ioremap_bar_init(odev);
 
 	ret = nvkm_device_pci_new(&odev->pdev, cfg, dbg, os_device_detect,
 				  os_device_mmio, os_device_subdev,
 				  &odev->device);
 	if (ret) {
 		fprintf(stderr, "failed to create device, %d\n", ret);
-		os_fini_device(odev);
+		nvkm_device_del(&odev->device);
+		os_ioremap_bar_fini(odev);
+		kfree(odev);
 		return ret;
 	}
 
+	*podev = odev;
 	return 0;
 }
 
+/* device construction is dominated by probing and BIOS shadowing, which
+ * is independent per device, so it's spread across a set of threads that
+ * each pick up the next unclaimed device.  devices are added to the list
+ * afterwards, in bus order, so the result doesn't depend on timing.
+ */
+#define OS_INIT_THREADS 8
+
+struct os_init_ctx {
+	const char *cfg;
+	const char *dbg;
+	struct pci_device **pdev;
+	struct os_device **odev;
+	int nr;
+	atomic_t next;
+};
+
+static void *
+os_init_thread(void *data)
+{
+	struct os_init_ctx *ctx = data;
+	int i;
+
+	while ((i = atomic_inc_return(&ctx->next) - 1) < ctx->nr)
+		os_init_device(ctx->pdev[i], ctx->cfg, ctx->dbg, &ctx->odev[i]);
+	return NULL;
+}
+
 static int
 os_init(const char *cfg, const char *dbg)
 {
+	struct os_init_ctx ctx = { .cfg = cfg, .dbg = dbg };
+	pthread_t thread[OS_INIT_THREADS - 1];
 	struct pci_device_iterator *iter;
-	struct pci_device *pdev;
-	int ret;
+	struct pci_device *pdev, **temp;
+	int ret, nr = 0, i;
 
 	ret = pci_system_init();
 	if (ret) {
@@ -203,9 +368,40 @@ os_init(const char *cfg, const char *dbg)
 		if (pdev->vendor_id != 0x10de)
 			continue;
 
-		os_init_device(pdev, cfg, dbg);
+		if (!(ctx.nr & (ctx.nr - 1))) {
+			temp = realloc(ctx.pdev, max(ctx.nr * 2, 1) *
+					       sizeof(*ctx.pdev));
+			if (!temp)
+				break;
+			ctx.pdev = temp;
+		}
+		ctx.pdev[ctx.nr++] = pdev;
 	}
 	pci_iterator_destroy(iter);
+
+	if (ctx.nr && !(ctx.odev = calloc(ctx.nr, sizeof(*ctx.odev)))) {
+		free(ctx.pdev);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < min(ctx.nr, OS_INIT_THREADS) - 1; i++) {
+		if (pthread_create(&thread[i], NULL, os_init_thread, &ctx))
+			break;
+		nr++;
+	}
+
+	os_init_thread(&ctx);
+
+	for (i = 0; i < nr; i++)
+		pthread_join(thread[i], NULL);
+
+	for (i = 0; i < ctx.nr; i++) {
+		if (ctx.odev[i])
+			list_add_tail(&ctx.odev[i]->head, &os_device_list);
+	}
+
+	free(ctx.odev);
+	free(ctx.pdev);
 	return 0;
 }
 
@@ -218,9 +414,81 @@ os_fini(void)
 		os_fini_device(odev);
 	}
 
+	os_firmware_fini();
 	pci_system_cleanup();
 }
 
+/******************************************************************************
+ * notify ring consumers, one per client created with NvNotifyRing=<order>
+ *****************************************************************************/
+struct os_client_ring {
+	struct list_head head;
+	struct nvkm_client *client;
+	pthread_t thread;
+	bool fini;
+};
+
+static LIST_HEAD(os_client_ring_list);
+static __thread struct nvkm_client *os_client_ring_self;
+
+static void *
+os_client_ring_func(void *arg)
+{
+	struct os_client_ring *ring = arg;
+	os_client_ring_self = ring->client;
+	while (!READ_ONCE(ring->fini)) {
+		if (nvkm_client_ring_wait(ring->client, HZ))
+			nvkm_client_ring_drain(ring->client, 64);
+	}
+	return NULL;
+}
+
+static void
+os_client_ring_fini(struct nvkm_client *client)
+{
+	struct os_client_ring *ring = NULL, *temp;
+
+	mutex_lock(&os_mutex);
+	list_for_each_entry(temp, &os_client_ring_list, head) {
+		if (temp->client == client) {
+			list_del(&temp->head);
+			ring = temp;
+			break;
+		}
+	}
+	mutex_unlock(&os_mutex);
+
+	if (ring) {
+		WRITE_ONCE(ring->fini, true);
+		nvkm_client_ring_kick(client);
+		pthread_join(ring->thread, NULL);
+		free(ring);
+	}
+}
+
+static int
+os_client_ring_init(struct nvkm_client *client, int order)
+{
+	struct os_client_ring *ring;
+	int ret;
+
+	if (!(ring = calloc(1, sizeof(*ring))))
+		return -ENOMEM;
+	ring->client = client;
+
+	if ((ret = nvkm_client_ring_new(client, order)) ||
+	    (ret = -pthread_create(&ring->thread, NULL,
+				   os_client_ring_func, ring))) {
+		free(ring);
+		return ret;
+	}
+
+	mutex_lock(&os_mutex);
+	list_add_tail(&ring->head, &os_client_ring_list);
+	mutex_unlock(&os_mutex);
+	return 0;
+}
+
 static void
 os_client_unmap(void *priv, void *ptr, u32 size)
 {
@@ -236,7 +504,26 @@ os_client_map(void *priv, u64 handle, u32 size)
 static int
 os_client_ioctl(void *priv, bool super, void *data, u32 size, void **hack)
 {
-	return nvkm_ioctl(priv, super, data, size, hack);
+	struct nvkm_client *client = priv;
+	struct nvif_ioctl_v0 *args = data;
+	int ret;
+
+	/* nvkm_ioctl() keeps per-call state (super, data) in the client,
+	 * and nvif_async gives a client a second thread to call from
+	 */
+	mutex_lock(&client->mutex);
+	ret = nvkm_ioctl(client, super, data, size, hack);
+	mutex_unlock(&client->mutex);
+
+	/* a reply queued before the notifier was disarmed may still be on
+	 * its way to ntfy(), so make sure it's done with the token before
+	 * the caller frees it.  that can't be waited for from ntfy() itself
+	 */
+	if (size >= sizeof(*args) && os_client_ring_self != priv &&
+	    (args->type == NVIF_IOCTL_V0_NTFY_PUT ||
+	     args->type == NVIF_IOCTL_V0_NTFY_DEL))
+		nvkm_client_ring_flush(priv);
+	return ret;
 }
 
 static int
@@ -256,6 +543,7 @@ os_client_fini(void *priv)
 {
 	struct nvkm_client *client = priv;
 
+	os_client_ring_fini(client);
 	nvkm_client_del(&client);
 
 	mutex_lock(&os_mutex);
@@ -269,7 +557,7 @@ os_client_init(const char *name, u64 device, const char *cfg,
 	       const char *dbg, void **ppriv)
 {
 	struct nvkm_client *client;
-	int ret;
+	int order, ret;
 
 	mutex_lock(&os_mutex);
 	if (os_client_nr++ == 0)
@@ -278,8 +566,14 @@ os_client_init(const char *name, u64 device, const char *cfg,
 
 	ret = nvkm_client_new(name, device, cfg, dbg, &client);
 	*ppriv = client;
-	if (ret == 0)
+	if (ret == 0) {
 		client->ntfy = nvif_notify;
+		order = nvkm_longopt(cfg, "NvNotifyRing", 0);
+		if (order && (ret = os_client_ring_init(client, order))) {
+			os_client_fini(client);
+			*ppriv = NULL;
+		}
+	}
 	return ret;
 }
 
@@ -0,0 +1,529 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+#include <core/subdev.h>
+
+static int
+os_mmio_cmp(const void *a, const void *b)
+{
+	const struct os_mmio_rec *ra = a, *rb = b;
+	if (ra->time != rb->time)
+		return ra->time < rb->time ? -1 : 1;
+	if (ra->thread != rb->thread)
+		return ra->thread < rb->thread ? -1 : 1;
+	return ra->seq < rb->seq ? -1 : ra->seq > rb->seq;
+}
+
+/* reads an entire trace, with the records sorted by time */
+int
+os_mmio_load(const char *path, struct os_mmio_head *head,
+	     struct os_mmio_rec **prec, u32 *pnr)
+{
+	struct os_mmio_rec *rec = NULL;
+	u32 nr = 0, max = 0, i;
+	int ret = -EINVAL;
+	FILE *file;
+
+	if (!(file = fopen(path, "rb")))
+		return -errno;
+
+	if (fread(head, sizeof(*head), 1, file) != 1 ||
+	    memcmp(head->magic, OS_MMIO_MAGIC, sizeof(head->magic)) ||
+	    head->version != 0 || head->size != sizeof(*rec))
+		goto done;
+
+	for (;;) {
+		if (nr == max) {
+			struct os_mmio_rec *temp;
+			max = max ? max * 2 : 65536;
+			if (!(temp = realloc(rec, max * sizeof(*rec)))) {
+				ret = -ENOMEM;
+				goto done;
+			}
+			rec = temp;
+		}
+
+		i = fread(&rec[nr], sizeof(*rec), max - nr, file);
+		nr += i;
+		if (nr < max)
+			break;
+	}
+
+	qsort(rec, nr, sizeof(*rec), os_mmio_cmp);
+	*prec = rec;
+	*pnr = nr;
+	rec = NULL;
+	ret = 0;
+done:
+	free(rec);
+	fclose(file);
+	return ret;
+}
+
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+/* every nvkm register access passes through here.  unless $NVOS_MMIO_TRACE
+ * or $NVOS_MMIO_REPLAY is set, that's all there is to it.
+ *
+ * when tracing, each thread logs its accesses into a ring of its own, and
+ * only takes the lock protecting the output file when the ring fills up,
+ * or the thread exits.
+ *
+ * when replaying, reads of each register return the values recorded for
+ * it in order, and writes are compared against those that were recorded.
+ * registers that weren't traced behave as plain memory.  once a register's
+ * recorded reads are used up its last value is returned, but a long run of
+ * those means the driver is spinning on something the trace can't satisfy,
+ * so replay is abandoned rather than hanging.
+ */
+enum os_mmio_mode {
+	OS_MMIO_OFF,
+	OS_MMIO_TRACE,
+	OS_MMIO_REPLAY,
+};
+
+#define OS_MMIO_RING     16384
+#define OS_MMIO_STALE    1000000
+#define OS_MMIO_MISMATCH 32
+
+struct os_mmio_ring {
+	struct list_head head;
+	u16 thread;
+	u32 seq;
+	u32 put;
+	struct os_mmio_rec rec[OS_MMIO_RING];
+};
+
+struct os_mmio_reg {
+	u32 addr;
+	u32 rd, rd_nr, rd_pos;
+	u32 wr, wr_nr, wr_pos;
+};
+
+static pthread_once_t os_mmio_once = PTHREAD_ONCE_INIT;
+static enum os_mmio_mode os_mmio_mode;
+static DEFINE_MUTEX(os_mmio_mutex);
+static __thread int os_mmio_index = OS_MMIO_NONE;
+
+/* tracing */
+static FILE *os_mmio_file;
+static struct nvkm_device *os_mmio_device;
+static pthread_key_t os_mmio_key;
+static LIST_HEAD(os_mmio_rings);
+static u32 os_mmio_threads;
+static u64 os_mmio_epoch;
+static __thread struct os_mmio_ring *os_mmio_ring;
+
+/* replay */
+static struct os_mmio_head os_mmio_head;
+static struct os_mmio_reg *os_mmio_regs;
+static u32 os_mmio_regs_mask;
+static u32 *os_mmio_data;
+static u32 os_mmio_stale;
+static u32 os_mmio_mismatch;
+
+static inline u32
+os_mmio_raw_rd(struct nvkm_device *device, u32 addr, int size)
+{
+	switch (size) {
+	case 1: return ioread8(device->pri + addr);
+	case 2: return ioread16_native(device->pri + addr);
+	default:
+		return ioread32_native(device->pri + addr);
+	}
+}
+
+static inline void
+os_mmio_raw_wr(struct nvkm_device *device, u32 addr, u32 data, int size)
+{
+	switch (size) {
+	case 1: iowrite8(data, device->pri + addr); break;
+	case 2: iowrite16_native(data, device->pri + addr); break;
+	default:
+		iowrite32_native(data, device->pri + addr);
+		break;
+	}
+}
+
+static const char *
+os_mmio_name(int index)
+{
+	if (index >= NVKM_SUBDEV_NR || !nvkm_subdev_name[index])
+		return "device";
+	return nvkm_subdev_name[index];
+}
+
+/******************************************************************************
+ * tracing
+ *****************************************************************************/
+static void
+os_mmio_flush(struct os_mmio_ring *ring)
+{
+	if (ring->put) {
+		fwrite(ring->rec, sizeof(*ring->rec), ring->put, os_mmio_file);
+		ring->put = 0;
+	}
+}
+
+static void
+os_mmio_thread_fini(void *data)
+{
+	struct os_mmio_ring *ring = data;
+
+	mutex_lock(&os_mmio_mutex);
+	os_mmio_flush(ring);
+	list_del(&ring->head);
+	mutex_unlock(&os_mmio_mutex);
+	free(ring);
+}
+
+static struct os_mmio_ring *
+os_mmio_thread_init(void)
+{
+	struct os_mmio_ring *ring;
+
+	if (!(ring = malloc(sizeof(*ring))))
+		return NULL;
+	ring->seq = 0;
+	ring->put = 0;
+
+	mutex_lock(&os_mmio_mutex);
+	ring->thread = os_mmio_threads++;
+	list_add_tail(&ring->head, &os_mmio_rings);
+	mutex_unlock(&os_mmio_mutex);
+
+	pthread_setspecific(os_mmio_key, ring);
+	return os_mmio_ring = ring;
+}
+
+/* the header describes the first device accessed, and is enough for the
+ * null driver to construct the same chipset again when replaying
+ */
+static void
+os_mmio_trace_head(struct nvkm_device *device)
+{
+	struct os_mmio_head head = {
+		.magic = OS_MMIO_MAGIC,
+		.version = 0,
+		.size = sizeof(struct os_mmio_rec),
+	};
+	int i;
+
+	mutex_lock(&os_mmio_mutex);
+	if (!os_mmio_device) {
+		head.boot0 = os_mmio_raw_rd(device, 0x000000, 4);
+		head.strap = os_mmio_raw_rd(device, 0x101000, 4);
+		for (i = 0; i < ARRAY_SIZE(head.bar); i++)
+			head.bar[i] = device->func->resource_size(device, i);
+		fwrite(&head, sizeof(head), 1, os_mmio_file);
+		os_mmio_epoch = nvos_clock(CLOCK_MONOTONIC);
+		WRITE_ONCE(os_mmio_device, device);
+	}
+	mutex_unlock(&os_mmio_mutex);
+}
+
+static void
+os_mmio_trace(struct nvkm_device *device, u32 addr, u32 data, u8 flags)
+{
+	struct os_mmio_ring *ring = os_mmio_ring;
+	struct os_mmio_rec *rec;
+
+	if (unlikely(!READ_ONCE(os_mmio_device)))
+		os_mmio_trace_head(device);
+	if (unlikely(!ring) && !(ring = os_mmio_thread_init()))
+		return;
+
+	rec = &ring->rec[ring->put];
+	rec->time = nvos_clock(CLOCK_MONOTONIC) - os_mmio_epoch;
+	rec->addr = addr;
+	rec->data = data;
+	rec->seq = ring->seq++;
+	rec->thread = ring->thread;
+	rec->subdev = os_mmio_index;
+	rec->flags = flags;
+
+	if (++ring->put == OS_MMIO_RING) {
+		mutex_lock(&os_mmio_mutex);
+		os_mmio_flush(ring);
+		mutex_unlock(&os_mmio_mutex);
+	}
+}
+
+/******************************************************************************
+ * replay
+ *****************************************************************************/
+static struct os_mmio_reg *
+os_mmio_reg(u32 addr)
+{
+	u32 hash = (addr * 0x9e3779b1) & os_mmio_regs_mask;
+
+	while (os_mmio_regs[hash].addr != addr) {
+		if (os_mmio_regs[hash].addr == ~0)
+			return NULL;
+		hash = (hash + 1) & os_mmio_regs_mask;
+	}
+
+	return &os_mmio_regs[hash];
+}
+
+static struct os_mmio_reg *
+os_mmio_reg_new(u32 addr)
+{
+	u32 hash = (addr * 0x9e3779b1) & os_mmio_regs_mask;
+
+	while (os_mmio_regs[hash].addr != addr) {
+		if (os_mmio_regs[hash].addr == ~0) {
+			os_mmio_regs[hash].addr = addr;
+			break;
+		}
+		hash = (hash + 1) & os_mmio_regs_mask;
+	}
+
+	return &os_mmio_regs[hash];
+}
+
+/* values are grouped by register, so each register's reads and writes
+ * form a contiguous run in os_mmio_data, in the order they happened
+ */
+static int
+os_mmio_replay_init(const char *path)
+{
+	struct os_mmio_rec *rec;
+	struct os_mmio_reg *reg;
+	u32 nr, size, next = 0, i;
+	int ret;
+
+	ret = os_mmio_load(path, &os_mmio_head, &rec, &nr);
+	if (ret)
+		return ret;
+
+	for (size = 1024; size < nr * 2ULL; size <<= 1)
+		;
+	os_mmio_regs = malloc(size * sizeof(*os_mmio_regs));
+	os_mmio_data = malloc(max(nr, 1U) * sizeof(*os_mmio_data));
+	if (!os_mmio_regs || !os_mmio_data) {
+		free(rec);
+		return -ENOMEM;
+	}
+
+	memset(os_mmio_regs, 0x00, size * sizeof(*os_mmio_regs));
+	for (i = 0; i < size; i++)
+		os_mmio_regs[i].addr = ~0;
+	os_mmio_regs_mask = size - 1;
+
+	for (i = 0; i < nr; i++) {
+		reg = os_mmio_reg_new(rec[i].addr);
+		if (rec[i].flags & OS_MMIO_WRITE)
+			reg->wr_nr++;
+		else
+			reg->rd_nr++;
+	}
+
+	for (i = 0; i < size; i++) {
+		reg = &os_mmio_regs[i];
+		reg->rd = next;
+		reg->wr = next + reg->rd_nr;
+		next += reg->rd_nr + reg->wr_nr;
+	}
+
+	for (i = 0; i < nr; i++) {
+		reg = os_mmio_reg(rec[i].addr);
+		if (rec[i].flags & OS_MMIO_WRITE)
+			os_mmio_data[reg->wr + reg->wr_pos++] = rec[i].data;
+		else
+			os_mmio_data[reg->rd + reg->rd_pos++] = rec[i].data;
+	}
+
+	for (i = 0; i < size; i++)
+		os_mmio_regs[i].rd_pos = os_mmio_regs[i].wr_pos = 0;
+
+	free(rec);
+	return 0;
+}
+
+static void
+os_mmio_replay_fini(void)
+{
+	u32 rd = 0, rd_nr = 0, wr = 0, wr_nr = 0, i;
+
+	for (i = 0; i <= os_mmio_regs_mask; i++) {
+		rd += min(os_mmio_regs[i].rd_pos, os_mmio_regs[i].rd_nr);
+		wr += min(os_mmio_regs[i].wr_pos, os_mmio_regs[i].wr_nr);
+		rd_nr += os_mmio_regs[i].rd_nr;
+		wr_nr += os_mmio_regs[i].wr_nr;
+	}
+
+	fprintf(stderr, "mmio replay: %u/%u reads, %u/%u writes, "
+			"%u mismatched\n", rd, rd_nr, wr, wr_nr,
+		os_mmio_mismatch);
+}
+
+static u32
+os_mmio_replay_rd(struct nvkm_device *device, u32 addr, int size)
+{
+	struct os_mmio_reg *reg;
+	u32 data;
+
+	mutex_lock(&os_mmio_mutex);
+	if (!(reg = os_mmio_reg(addr)) || !reg->rd_nr) {
+		data = os_mmio_raw_rd(device, addr, size);
+	} else
+	if (reg->rd_pos < reg->rd_nr) {
+		data = os_mmio_data[reg->rd + reg->rd_pos++];
+		os_mmio_stale = 0;
+	} else {
+		data = os_mmio_data[reg->rd + reg->rd_nr - 1];
+		if (++os_mmio_stale == OS_MMIO_STALE) {
+			fprintf(stderr, "mmio replay: %s diverged from trace "
+					"polling %06x\n",
+				os_mmio_name(os_mmio_index), addr);
+			os_mmio_replay_fini();
+			abort();
+		}
+	}
+	mutex_unlock(&os_mmio_mutex);
+	return data;
+}
+
+static void
+os_mmio_replay_wr(struct nvkm_device *device, u32 addr, u32 data, int size)
+{
+	struct os_mmio_reg *reg;
+
+	mutex_lock(&os_mmio_mutex);
+	os_mmio_raw_wr(device, addr, data, size);
+	if ((reg = os_mmio_reg(addr)) && reg->wr_pos < reg->wr_nr) {
+		u32 want = os_mmio_data[reg->wr + reg->wr_pos++];
+		if (want != data && os_mmio_mismatch++ < OS_MMIO_MISMATCH) {
+			fprintf(stderr, "mmio replay: %s wr %06x %08x, "
+					"expected %08x\n",
+				os_mmio_name(os_mmio_index), addr, data, want);
+		}
+	} else {
+		if (reg)
+			reg->wr_pos++;
+		if (os_mmio_mismatch++ < OS_MMIO_MISMATCH) {
+			fprintf(stderr, "mmio replay: %s wr %06x %08x, "
+					"not in trace\n",
+				os_mmio_name(os_mmio_index), addr, data);
+		}
+	}
+	mutex_unlock(&os_mmio_mutex);
+}
+
+/******************************************************************************
+ * accessors
+ *****************************************************************************/
+static void
+os_mmio_fini(void)
+{
+	struct os_mmio_ring *ring;
+
+	switch (os_mmio_mode) {
+	case OS_MMIO_TRACE:
+		mutex_lock(&os_mmio_mutex);
+		list_for_each_entry(ring, &os_mmio_rings, head)
+			os_mmio_flush(ring);
+		fflush(os_mmio_file);
+		mutex_unlock(&os_mmio_mutex);
+		break;
+	case OS_MMIO_REPLAY:
+		os_mmio_replay_fini();
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+os_mmio_init(void)
+{
+	const char *path;
+	int ret;
+
+	if ((path = getenv("NVOS_MMIO_REPLAY"))) {
+		if ((ret = os_mmio_replay_init(path))) {
+			fprintf(stderr, "mmio replay: %s: %d\n", path, ret);
+			return;
+		}
+		os_mmio_mode = OS_MMIO_REPLAY;
+	} else
+	if ((path = getenv("NVOS_MMIO_TRACE"))) {
+		if (pthread_key_create(&os_mmio_key, os_mmio_thread_fini) ||
+		    !(os_mmio_file = fopen(path, "wb"))) {
+			fprintf(stderr, "mmio trace: %s: %d\n", path, -errno);
+			return;
+		}
+		os_mmio_mode = OS_MMIO_TRACE;
+	} else {
+		return;
+	}
+
+	atexit(os_mmio_fini);
+}
+
+const struct os_mmio_head *
+os_mmio_replay(void)
+{
+	pthread_once(&os_mmio_once, os_mmio_init);
+	if (os_mmio_mode != OS_MMIO_REPLAY)
+		return NULL;
+	return &os_mmio_head;
+}
+
+int
+nvkm_mmio_subdev(int index)
+{
+	int prev = os_mmio_index;
+	os_mmio_index = index < 0 ? OS_MMIO_NONE : index;
+	return prev;
+}
+
+u32
+nvkm_mmio_rd(struct nvkm_device *device, u32 addr, int size)
+{
+	u32 data;
+
+	pthread_once(&os_mmio_once, os_mmio_init);
+	if (unlikely(os_mmio_mode == OS_MMIO_REPLAY))
+		return os_mmio_replay_rd(device, addr, size);
+
+	data = os_mmio_raw_rd(device, addr, size);
+	if (unlikely(os_mmio_mode == OS_MMIO_TRACE))
+		os_mmio_trace(device, addr, data, size);
+	return data;
+}
+
+void
+nvkm_mmio_wr(struct nvkm_device *device, u32 addr, u32 data, int size)
+{
+	pthread_once(&os_mmio_once, os_mmio_init);
+	if (unlikely(os_mmio_mode == OS_MMIO_REPLAY)) {
+		os_mmio_replay_wr(device, addr, data, size);
+		return;
+	}
+
+	os_mmio_raw_wr(device, addr, data, size);
+	if (unlikely(os_mmio_mode == OS_MMIO_TRACE))
+		os_mmio_trace(device, addr, data, size | OS_MMIO_WRITE);
+}
+#endif
@@ -22,6 +22,8 @@
  * Authors: Ben Skeggs
  */
 
+#include <sys/mman.h>
+
 #include <nvif/client.h>
 #include <nvif/driver.h>
 #include <nvif/notify.h>
@@ -44,6 +46,10 @@ null_pci_dev = {
 	},
 	.pdev = &(struct pci_device) {
 	},
+	/* no uio device matches line 0, so its handlers only run when
+	 * null_intr_trigger() raises it
+	 */
+	.irq = 0,
 	.bus = &null_pci_dev._bus,
 };
 
@@ -53,31 +59,211 @@ null_fini(void)
 	nvkm_device_del(&null_device);
 }
 
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+/* when replaying a register trace, the device's BARs are backed by memory
+ * so the chipset recorded in the trace is detected, and the subdevs for it
+ * constructed, as if the hardware were present
+ */
+static struct os_ioremap_bar null_bar[6];
+
+static void
+null_replay(void)
+{
+	const struct os_mmio_head *head = os_mmio_replay();
+	struct pci_device *pdev = null_pci_dev.pdev;
+	int i;
+
+	if (!head || null_bar[0].size)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(null_bar); i++) {
+		u64 addr = (u64)(i + 1) << 36;
+		if (!head->bar[i] || os_ioremap_ram(&null_bar[i], addr,
+						    head->bar[i]))
+			continue;
+		pdev->regions[i].base_addr = addr;
+		pdev->regions[i].size = head->bar[i];
+	}
+
+	if (null_bar[0].size >= 0x102000) {
+		iowrite32_native(head->boot0, null_bar[0].ptr + 0x000000);
+		iowrite32_native(head->strap, null_bar[0].ptr + 0x101000);
+	}
+}
+
+/* while replaying, mappings of the device's BARs must see the same memory
+ * the device's own register accesses do, anything else can't be backed
+ */
+static bool
+null_replay_map(u64 handle, u32 size, void **pptr)
+{
+	int i;
+
+	if (!null_bar[0].size)
+		return false;
+
+	*pptr = NULL;
+	for (i = 0; i < ARRAY_SIZE(null_bar); i++) {
+		if (handle        >= null_bar[i].addr &&
+		    handle + size <= null_bar[i].addr + null_bar[i].size) {
+			*pptr = ioremap(handle, size);
+			break;
+		}
+	}
+	return true;
+}
+
+static bool
+null_replay_unmap(void *ptr)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(null_bar); i++) {
+		if (null_bar[i].size && ptr >= null_bar[i].ptr &&
+		    ptr <  null_bar[i].ptr + null_bar[i].size) {
+			iounmap(ptr);
+			return true;
+		}
+	}
+	return false;
+}
+#endif
+
+/* the null device's interrupt line, for handlers that want to share it */
+int
+null_intr_line(void)
+{
+	int ret;
+
+	mutex_lock(&null_mutex);
+	ret = null_device ? null_pci_dev.irq : -ENODEV;
+	mutex_unlock(&null_mutex);
+	return ret;
+}
+
+/* raises the null device's interrupt, running every handler registered on
+ * its line.  that's nvkm's own whenever the device has a PCI subdev, as it
+ * does when replaying a trace, where the interrupt status it reads back is
+ * the replayed register state
+ */
+int
+null_intr_trigger(void)
+{
+	int ret = -ENODEV;
+
+	mutex_lock(&null_mutex);
+	if (null_device && os_intr_trigger(null_pci_dev.irq, NULL))
+		ret = 0;
+	mutex_unlock(&null_mutex);
+	return ret;
+}
+
 static void
 null_init(const char *cfg, const char *dbg, bool init)
 {
-	int ret = nvkm_device_pci_new(&null_pci_dev, cfg, dbg, os_device_detect,
-				      os_device_mmio, os_device_subdev,
-				      &null_device);
+	int ret;
+
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+	null_replay();
+#endif
+	ret = nvkm_device_pci_new(&null_pci_dev, cfg, dbg, os_device_detect,
+				  os_device_mmio, os_device_subdev,
+				  &null_device);
 	if (ret)
 		null_fini();
 }
 
+/* there's no hardware behind the null driver, so mappings are backed by
+ * anonymous shared memory instead.  every mapping of the same handle gets
+ * the same buffer, so accesses through one object are visible via others
+ */
+struct null_map {
+	struct list_head head;
+	u64 handle;
+	u32 size;
+	void *ptr;
+	int refs;
+};
+
+static LIST_HEAD(null_maps);
+
 static void
 null_client_unmap(void *priv, void *ptr, u32 size)
 {
+	struct null_map *map;
+
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+	if (null_replay_unmap(ptr))
+		return;
+#endif
+
+	mutex_lock(&null_mutex);
+	list_for_each_entry(map, &null_maps, head) {
+		if (map->ptr == ptr) {
+			if (--map->refs == 0) {
+				list_del(&map->head);
+				munmap(map->ptr, map->size);
+				free(map);
+			}
+			break;
+		}
+	}
+	mutex_unlock(&null_mutex);
 }
 
 static void *
 null_client_map(void *priv, u64 handle, u32 size)
 {
-	return NULL;
+	struct null_map *map;
+	void *ptr = NULL;
+
+	if (!size)
+		return NULL;
+
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+	if (null_replay_map(handle, size, &ptr))
+		return ptr;
+#endif
+
+	mutex_lock(&null_mutex);
+	list_for_each_entry(map, &null_maps, head) {
+		if (map->handle == handle && map->size == size) {
+			map->refs++;
+			ptr = map->ptr;
+			goto done;
+		}
+	}
+
+	if (!(map = malloc(sizeof(*map))))
+		goto done;
+
+	map->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (map->ptr == MAP_FAILED) {
+		free(map);
+		goto done;
+	}
+
+	map->handle = handle;
+	map->size = size;
+	map->refs = 1;
+	list_add(&map->head, &null_maps);
+	ptr = map->ptr;
+done:
+	mutex_unlock(&null_mutex);
+	return ptr;
 }
 
 static int
 null_client_ioctl(void *priv, bool super, void *data, u32 size, void **hack)
 {
-	return nvkm_ioctl(priv, super, data, size, hack);
+	struct nvkm_client *client = priv;
+	int ret;
+
+	mutex_lock(&client->mutex);
+	ret = nvkm_ioctl(client, super, data, size, hack);
+	mutex_unlock(&client->mutex);
+	return ret;
 }
 
 static int
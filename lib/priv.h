@@ -6,15 +6,66 @@
 #include <pthread.h>
 #include <unistd.h>
 
+struct os_ioremap_bar {
+	struct os_ioremap_bar *next;
+	struct pci_device *pdev;
+	u64 addr;
+	u64 size;
+	void __iomem *ptr;
+	int refs;
+};
+
 struct os_device {
 	struct nvkm_device *device;
 	struct list_head head;
 	char *cfg;
 	char *dbg;
 	struct pci_dev pdev;
+	struct os_ioremap_bar bar[6];
 };
 
 extern bool os_device_detect;
 extern bool os_device_mmio;
 extern u64  os_device_subdev;
+
+/* register access trace, as written by lib/mmio.c.  a struct os_mmio_head
+ * describing the traced device, followed by records from each thread's
+ * ring in the order the rings filled up, so not necessarily sorted by time
+ */
+struct os_mmio_head {
+	char magic[4];
+#define OS_MMIO_MAGIC "NVMT"
+	u16 version;
+	u16 size;
+	u32 boot0;
+	u32 strap;
+	u64 bar[6];
+};
+
+struct os_mmio_rec {
+	u64 time;
+	u32 addr;
+	u32 data;
+	u32 seq;
+	u16 thread;
+	u8  subdev;
+#define OS_MMIO_NONE  0xff
+	u8  flags;
+#define OS_MMIO_SIZE  0x07
+#define OS_MMIO_WRITE 0x80
+};
+
+int  os_mmio_load(const char *path, struct os_mmio_head *,
+		  struct os_mmio_rec **, u32 *nr);
+#ifdef CONFIG_NOUVEAU_MMIO_TRACE
+const struct os_mmio_head *os_mmio_replay(void);
+int  os_ioremap_ram(struct os_ioremap_bar *, u64 addr, u64 size);
+#endif
+
+int  os_intr_trigger(unsigned int irq, void *dev);
+int  null_intr_line(void);
+int  null_intr_trigger(void);
+void os_firmware_fini(void);
+
+int nvshm_server(const char *drv, const char *cfg, const char *dbg);
 #endif
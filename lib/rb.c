@@ -23,70 +23,241 @@
  */
 #include <core/os.h>
 
-/*XXX: this is just an unbalanced bst with linux's rbtree interface */
+static void
+rb_replace_child(struct rb_node *old, struct rb_node *new,
+		 struct rb_node *parent, struct rb_root *root)
+{
+	if (parent) {
+		if (parent->rb_left == old)
+			parent->rb_left = new;
+		else
+			parent->rb_right = new;
+	} else {
+		root->rb_node = new;
+	}
+}
+
+static void
+rb_rotate_left(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *right = node->rb_right;
+	struct rb_node *parent = node->parent;
+
+	if ((node->rb_right = right->rb_left))
+		right->rb_left->parent = node;
+	right->rb_left = node;
+	right->parent = parent;
+	rb_replace_child(node, right, parent, root);
+	node->parent = right;
+}
+
+static void
+rb_rotate_right(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *left = node->rb_left;
+	struct rb_node *parent = node->parent;
+
+	if ((node->rb_left = left->rb_right))
+		left->rb_right->parent = node;
+	left->rb_right = node;
+	left->parent = parent;
+	rb_replace_child(node, left, parent, root);
+	node->parent = left;
+}
+
+static inline bool
+rb_is_red(struct rb_node *node)
+{
+	return node && node->rb_color == RB_RED;
+}
+
+static inline bool
+rb_is_black(struct rb_node *node)
+{
+	return !rb_is_red(node);
+}
 
 void
 rb_link_node(struct rb_node *node, struct rb_node *parent, struct rb_node **ptr)
 {
 	node->parent = parent;
+	node->rb_left = node->rb_right = NULL;
+	node->rb_color = RB_RED;
 	*ptr = node;
 }
 
 void
 rb_insert_color(struct rb_node *node, struct rb_root *root)
 {
+	struct rb_node *parent, *gparent, *uncle;
+
+	while ((parent = node->parent) && parent->rb_color == RB_RED) {
+		/* parent is red, so it can't be the root */
+		gparent = parent->parent;
+
+		if (parent == gparent->rb_left) {
+			uncle = gparent->rb_right;
+			if (rb_is_red(uncle)) {
+				/* recolour and continue up from grandparent */
+				uncle->rb_color = RB_BLACK;
+				parent->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->rb_right) {
+				rb_rotate_left(parent, root);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_right(gparent, root);
+		} else {
+			uncle = gparent->rb_left;
+			if (rb_is_red(uncle)) {
+				uncle->rb_color = RB_BLACK;
+				parent->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->rb_left) {
+				rb_rotate_right(parent, root);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_left(gparent, root);
+		}
+	}
+
+	root->rb_node->rb_color = RB_BLACK;
+}
+
+/* restore the black-height after removing a black node, "node" (possibly
+ * NULL) is the child that took its place and carries an extra black
+ */
+static void
+rb_erase_color(struct rb_node *node, struct rb_node *parent,
+	       struct rb_root *root)
+{
+	struct rb_node *sibling;
+
+	while (node != root->rb_node && rb_is_black(node)) {
+		if (node == parent->rb_left) {
+			sibling = parent->rb_right;
+			if (rb_is_red(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_left(parent, root);
+				sibling = parent->rb_right;
+			}
+
+			if (rb_is_black(sibling->rb_left) &&
+			    rb_is_black(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (rb_is_black(sibling->rb_right)) {
+				sibling->rb_left->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_right(sibling, root);
+				sibling = parent->rb_right;
+			}
+
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_right->rb_color = RB_BLACK;
+			rb_rotate_left(parent, root);
+			node = root->rb_node;
+		} else {
+			sibling = parent->rb_left;
+			if (rb_is_red(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_right(parent, root);
+				sibling = parent->rb_left;
+			}
+
+			if (rb_is_black(sibling->rb_left) &&
+			    rb_is_black(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (rb_is_black(sibling->rb_left)) {
+				sibling->rb_right->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_left(sibling, root);
+				sibling = parent->rb_left;
+			}
+
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_left->rb_color = RB_BLACK;
+			rb_rotate_right(parent, root);
+			node = root->rb_node;
+		}
+	}
+
+	if (node)
+		node->rb_color = RB_BLACK;
 }
 
 void
 rb_erase(struct rb_node *node, struct rb_root *root)
 {
-	struct rb_node **ptr;
-
-	/* determine which parent pointer needs replacing */
-	if (node->parent) {
-		if (node == node->parent->rb_left)
-			ptr = &node->parent->rb_left;
-		else
-			ptr = &node->parent->rb_right;
-	} else {
-		ptr = &root->rb_node;
-	}
+	struct rb_node *child, *parent;
+	int color;
 
 	if (node->rb_left && node->rb_right) {
-		/* find the largest value to the left of the deleted
-		 * node, this will take its place in the tree
+		/* swap the deleted node with its in-order successor, which
+		 * has at most a right child, and remove that position instead
 		 */
-		struct rb_node *lr = node->rb_left;
-		while (lr->rb_right)
-			lr = lr->rb_right;
-		/* if this isn't the immediate left of the deleted node,
-		 * search down to find the smallest value and link the
-		 * immediate left of the deleted node there
-		 */
-		if (node->rb_left != lr) {
-			struct rb_node *lrl = lr;
-			while (lrl->rb_left)
-				lrl = lrl->rb_left;
-			lrl->rb_left = node->rb_left;
-			lrl->rb_left->parent = lrl;
-			lr->parent->rb_right = NULL;
+		struct rb_node *next = node->rb_right;
+		while (next->rb_left)
+			next = next->rb_left;
+
+		child = next->rb_right;
+		parent = next->parent;
+		color = next->rb_color;
+
+		if (parent == node) {
+			parent = next;
+		} else {
+			if (child)
+				child->parent = parent;
+			parent->rb_left = child;
+			next->rb_right = node->rb_right;
+			next->rb_right->parent = next;
 		}
-		/* link into the deleted node's position */
-		lr->parent = node->parent;
-		lr->rb_right = node->rb_right;
-		lr->rb_right->parent = lr;
-		*ptr = lr;
-	} else
-	if (node->rb_left) {
-		/* move left node into the deleted node's position */
-		node->rb_left->parent = node->parent;
-		*ptr = node->rb_left;
-	} else
-	if (node->rb_right) {
-		/* move right node into the deleted node's position */
-		node->rb_right->parent = node->parent;
-		*ptr = node->rb_right;
+
+		next->parent = node->parent;
+		next->rb_color = node->rb_color;
+		next->rb_left = node->rb_left;
+		next->rb_left->parent = next;
+		rb_replace_child(node, next, node->parent, root);
 	} else {
-		*ptr = NULL;
+		child = node->rb_left ? node->rb_left : node->rb_right;
+		parent = node->parent;
+		color = node->rb_color;
+
+		if (child)
+			child->parent = parent;
+		rb_replace_child(node, child, parent, root);
 	}
+
+	if (color == RB_BLACK)
+		rb_erase_color(child, parent, root);
 }
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+long nvos_rcu_count[2];
+u32  nvos_rcu_gp;
+__thread int nvos_rcu_nest;
+__thread int nvos_rcu_idx;
+
+static DEFINE_MUTEX(nvos_rcu_mutex);
+
+static void
+nvos_rcu_flip(void)
+{
+	u32 idx = __atomic_fetch_add(&nvos_rcu_gp, 1, __ATOMIC_SEQ_CST) & 1;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&nvos_rcu_count[idx], __ATOMIC_ACQUIRE))
+		nvos_nsleep(NSEC_PER_USEC);
+}
+
+void
+synchronize_rcu(void)
+{
+	if (WARN_ON(nvos_rcu_nest))
+		return;
+
+	mutex_lock(&nvos_rcu_mutex);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	nvos_rcu_flip();
+	nvos_rcu_flip();
+	mutex_unlock(&nvos_rcu_mutex);
+}
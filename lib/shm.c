@@ -0,0 +1,763 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+
+#include <nvif/client.h>
+#include <nvif/driver.h>
+#include <nvif/notify.h>
+#include <nvif/unpack.h>
+#include <nvif/event.h>
+#include <nvif/ioctl.h>
+
+#include "priv.h"
+
+/******************************************************************************
+ * shared-memory transport between libnvif clients and an nvif server
+ *
+ * a client connects to the server's unix socket and hands it a memfd
+ * holding a channel, the socket is otherwise only used to detect either
+ * end going away.  requests are written into the channel and copied out
+ * by the server before being executed, with sequence numbers that double
+ * as futexes for the doorbells in each direction.  notify replies are
+ * pushed by the server onto a ring in the same channel.
+ *
+ * the socket lives in the user's runtime directory, and each end checks
+ * the other's credentials, only the server's own user (or root) may use
+ * it.  everything in the channel is writable by the client at any time,
+ * so the server never trusts anything it has read from there twice, but
+ * the channel's size is sealed, so the mapping itself stays valid.
+ *****************************************************************************/
+#define NVSHM_DATA (64 * 1024)
+#define NVSHM_NTFY (64 * 1024)
+#define NVSHM_SPIN 4000
+#define NVSHM_POLL 100 /* ms */
+
+struct nvshm_chan {
+	u32 req;
+	u32 rep;
+	u32 ntfy;
+	u32 size;
+	s32 ret;
+
+	u32 ntfy_get;
+	u32 ntfy_put;
+	u8  ntfy_data[NVSHM_NTFY];
+
+	u8  data[NVSHM_DATA];
+};
+
+/* 'size' is the space taken by the whole record, a record with size 0
+ * marks the rest of the ring as unused, and has the consumer wrap back to
+ * the start.  'data' holds the reply header followed by its data.
+ */
+struct nvshm_ntfy {
+	u32 size;
+	u32 length;
+	u32 count;
+	u32 pad0c;
+	u8  data[];
+};
+
+/* sent with the channel's memfd when connecting */
+struct nvshm_hello {
+	char name[32];
+	char cfg[256];
+	char dbg[256];
+	u64 device;
+};
+
+static void
+nvshm_path(struct sockaddr_un *addr)
+{
+	const char *path = getenv("NVIF_SERVER");
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	const size_t size = sizeof(addr->sun_path);
+
+	if (path)
+		snprintf(addr->sun_path, size, "%s", path);
+	else
+	if (dir)
+		snprintf(addr->sun_path, size, "%s/nvif-server", dir);
+	else
+		snprintf(addr->sun_path, size, "/tmp/.nvif-server-%u", geteuid());
+}
+
+/* the other end must be running as us, or as root */
+static bool
+nvshm_trusted(int fd)
+{
+	struct ucred cred;
+	socklen_t size = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) < 0)
+		return false;
+	return cred.uid == 0 || cred.uid == geteuid();
+}
+
+static bool
+nvshm_alive(int fd)
+{
+	char c;
+	ssize_t ret = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return ret > 0 || (ret < 0 && errno == EAGAIN);
+}
+
+static void
+nvshm_wake(u32 *seq)
+{
+	syscall(SYS_futex, seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* waits for the sequence number to move on from 'prev', spinning briefly
+ * first since the other end usually answers within microseconds (unless
+ * there's only one cpu, and it can't be running meanwhile)
+ */
+static int nvshm_spin = -1;
+
+static int
+nvshm_wait(u32 *seq, u32 prev, int fd)
+{
+	const struct timespec timeout = {
+		.tv_nsec = NVSHM_POLL * NSEC_PER_MSEC,
+	};
+	int i;
+
+	if (unlikely(nvshm_spin < 0))
+		nvshm_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? NVSHM_SPIN : 0;
+
+	for (i = 0; i < nvshm_spin; i++) {
+		if (__atomic_load_n(seq, __ATOMIC_ACQUIRE) != prev)
+			return 0;
+		cpu_relax();
+	}
+
+	while (__atomic_load_n(seq, __ATOMIC_ACQUIRE) == prev) {
+		if (syscall(SYS_futex, seq, FUTEX_WAIT, prev, &timeout,
+			    NULL, 0) && errno == ETIMEDOUT && !nvshm_alive(fd))
+			return -ENODEV;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+ * client
+ *****************************************************************************/
+struct shm_client_priv {
+	struct nvshm_chan *chan;
+	struct mutex mutex;
+	int fd;
+	pthread_t event;
+	bool done;
+	bool fini;
+};
+
+static void
+shm_client_unmap(void *priv, void *ptr, u32 size)
+{
+}
+
+static void *
+shm_client_map(void *priv, u64 handle, u32 size)
+{
+	/* mapping handles are addresses in the server's view of the device */
+	return NULL;
+}
+
+static int
+shm_client_ioctl(void *priv, bool super, void *data, u32 size, void **hack)
+{
+	struct shm_client_priv *shm = priv;
+	struct nvshm_chan *chan = shm->chan;
+	u32 prev;
+	int ret;
+
+	if (size > sizeof(chan->data))
+		return -E2BIG;
+
+	mutex_lock(&shm->mutex);
+	memcpy(chan->data, data, size);
+	chan->size = size;
+	prev = chan->rep;
+	__atomic_add_fetch(&chan->req, 1, __ATOMIC_RELEASE);
+	nvshm_wake(&chan->req);
+
+	ret = nvshm_wait(&chan->rep, prev, shm->fd);
+	if (ret == 0) {
+		memcpy(data, chan->data, size);
+		ret = chan->ret;
+	}
+	mutex_unlock(&shm->mutex);
+	return ret;
+}
+
+static int
+shm_client_resume(void *priv)
+{
+	return -EINVAL;
+}
+
+static int
+shm_client_suspend(void *priv)
+{
+	return -ENOSYS;
+}
+
+static void *
+shm_client_event(void *arg)
+{
+	struct shm_client_priv *shm = arg;
+	struct nvshm_chan *chan = shm->chan;
+	struct nvshm_ntfy *ntfy;
+	u32 seq, get, put;
+
+	while (!READ_ONCE(shm->fini)) {
+		seq = __atomic_load_n(&chan->ntfy, __ATOMIC_ACQUIRE);
+		get = chan->ntfy_get;
+		put = __atomic_load_n(&chan->ntfy_put, __ATOMIC_ACQUIRE);
+		while (get != put) {
+			ntfy = (void *)&chan->ntfy_data[get];
+			if (!ntfy->size) {
+				get = 0;
+				continue;
+			}
+
+			nvif_notify(ntfy->data, ntfy->length,
+				    ntfy->data + ntfy->length, ntfy->count);
+			get += ntfy->size;
+		}
+		__atomic_store_n(&chan->ntfy_get, get, __ATOMIC_RELEASE);
+
+		if (nvshm_wait(&chan->ntfy, seq, shm->fd))
+			break;
+	}
+
+	return NULL;
+}
+
+static void
+shm_client_fini(void *priv)
+{
+	struct shm_client_priv *shm = priv;
+	if (shm) {
+		if (shm->done) {
+			/* kick the event thread out of its wait */
+			WRITE_ONCE(shm->fini, true);
+			__atomic_add_fetch(&shm->chan->ntfy, 1, __ATOMIC_RELEASE);
+			nvshm_wake(&shm->chan->ntfy);
+			pthread_join(shm->event, NULL);
+		}
+		if (shm->chan)
+			munmap(shm->chan, sizeof(*shm->chan));
+		if (shm->fd >= 0)
+			close(shm->fd);
+		free(shm);
+	}
+}
+
+static int
+shm_client_init(const char *name, u64 device, const char *cfg,
+		const char *dbg, void **ppriv)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct nvshm_hello hello = { .device = device };
+	struct shm_client_priv *shm;
+	char cmsg[CMSG_SPACE(sizeof(int))] = {};
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg,
+		.msg_controllen = sizeof(cmsg),
+	};
+	int memfd, ret;
+
+	*ppriv = NULL;
+	if (!(shm = calloc(1, sizeof(*shm))))
+		return -ENOMEM;
+	mutex_init(&shm->mutex);
+	shm->fd = -1;
+
+	nvshm_path(&addr);
+	if ((shm->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+	    connect(shm->fd, (void *)&addr, sizeof(addr)) < 0 ||
+	    !nvshm_trusted(shm->fd)) {
+		ret = -ENODEV;
+		goto fail;
+	}
+
+	if ((memfd = memfd_create("nvif-shm", MFD_CLOEXEC |
+						  MFD_ALLOW_SEALING)) < 0) {
+		ret = -errno;
+		goto fail;
+	}
+
+	/* the server refuses channels that could be resized under it */
+	if (ftruncate(memfd, sizeof(*shm->chan)) < 0 ||
+	    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				      F_SEAL_SEAL) < 0 ||
+	    (shm->chan = mmap(NULL, sizeof(*shm->chan),
+			      PROT_READ | PROT_WRITE, MAP_SHARED,
+			      memfd, 0)) == MAP_FAILED) {
+		shm->chan = NULL;
+		close(memfd);
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	snprintf(hello.name, sizeof(hello.name), "%s", name ? name : "");
+	snprintf(hello.cfg, sizeof(hello.cfg), "%s", cfg ? cfg : "");
+	snprintf(hello.dbg, sizeof(hello.dbg), "%s", dbg ? dbg : "");
+	CMSG_FIRSTHDR(&msg)->cmsg_level = SOL_SOCKET;
+	CMSG_FIRSTHDR(&msg)->cmsg_type = SCM_RIGHTS;
+	CMSG_FIRSTHDR(&msg)->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(CMSG_FIRSTHDR(&msg)), &memfd, sizeof(int));
+
+	ret = sendmsg(shm->fd, &msg, MSG_NOSIGNAL);
+	close(memfd);
+	if (ret != sizeof(hello) ||
+	    recv(shm->fd, &ret, sizeof(ret), MSG_WAITALL) != sizeof(ret)) {
+		ret = -ENODEV;
+		goto fail;
+	}
+
+	if (ret == 0 &&
+	    !(ret = -pthread_create(&shm->event, NULL, shm_client_event, shm))) {
+		shm->done = true;
+		*ppriv = shm;
+		return 0;
+	}
+
+fail:
+	shm_client_fini(shm);
+	return ret;
+}
+
+const struct nvif_driver
+nvif_driver_shm = {
+	.name = "shm",
+	.init = shm_client_init,
+	.fini = shm_client_fini,
+	.suspend = shm_client_suspend,
+	.resume = shm_client_resume,
+	.ioctl = shm_client_ioctl,
+	.map = shm_client_map,
+	.unmap = shm_client_unmap,
+	.ioctl_max = NVSHM_DATA,
+	.keep = true,
+};
+
+/******************************************************************************
+ * server
+ *****************************************************************************/
+struct nvshm_server_chan {
+	const struct nvif_driver *drv;
+	struct nvshm_chan *chan;
+	void *priv;
+	int fd;
+	bool super;
+	spinlock_t lock;
+	struct list_head ntfy;
+	u32 ntfy_put;
+	u64 data[NVSHM_DATA / 8];
+};
+
+/* notify tokens are swapped for one of these before the request reaches
+ * nvkm, so replies can be routed back to the right channel
+ */
+struct nvshm_server_ntfy {
+	struct list_head head;
+	struct nvshm_server_chan *chan;
+	int index;
+	u32 reply;
+	u8  route;
+	u64 token;
+};
+
+static int
+nvshm_server_notify(const void *header, u32 length, const void *data, u32 size)
+{
+	const union {
+		struct nvif_notify_rep_v0 v0;
+	} *rep = header;
+	struct nvshm_server_ntfy *ntfy;
+	struct nvshm_server_chan *sc;
+	struct nvshm_chan *chan;
+	struct nvif_notify_rep_v0 *out;
+	struct nvshm_ntfy *rec;
+	u32 need, get, put;
+
+	if (WARN_ON(length != sizeof(rep->v0) || rep->v0.version != 0))
+		return NVIF_NOTIFY_DROP;
+	if (WARN_ON(!(ntfy = (void *)(unsigned long)rep->v0.token)))
+		return NVIF_NOTIFY_DROP;
+	if (WARN_ON(ntfy->reply != length + size))
+		return NVIF_NOTIFY_DROP;
+
+	sc = ntfy->chan;
+	chan = sc->chan;
+	need = ALIGN(sizeof(*rec) + length + size, 8);
+
+	spin_lock(&sc->lock);
+	get = __atomic_load_n(&chan->ntfy_get, __ATOMIC_ACQUIRE);
+	put = sc->ntfy_put;
+	if (get >= sizeof(chan->ntfy_data))
+		goto full;
+	if (put >= get && put + need + sizeof(*rec) > sizeof(chan->ntfy_data)) {
+		/* no room before the end of the ring, wrap around */
+		if (get == 0 || need >= get)
+			goto full;
+		rec = (void *)&chan->ntfy_data[put];
+		rec->size = 0;
+		put = 0;
+	} else
+	if (put < get && put + need >= get)
+		goto full;
+
+	rec = (void *)&chan->ntfy_data[put];
+	rec->size = need;
+	rec->length = length;
+	rec->count = size;
+	memcpy(rec->data, header, length);
+	memcpy(rec->data + length, data, size);
+	out = (void *)rec->data;
+	out->route = ntfy->route;
+	out->token = ntfy->token;
+
+	sc->ntfy_put = put + need;
+	__atomic_store_n(&chan->ntfy_put, put + need, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&chan->ntfy, 1, __ATOMIC_RELEASE);
+	spin_unlock(&sc->lock);
+	nvshm_wake(&chan->ntfy);
+	return NVIF_NOTIFY_DROP;
+
+full:
+	/* the client isn't keeping up, the reply is lost */
+	spin_unlock(&sc->lock);
+	WARN_ON_ONCE(1);
+	return NVIF_NOTIFY_DROP;
+}
+
+static struct nvshm_server_ntfy *
+nvshm_server_ntfy_find(struct nvshm_server_chan *sc, int index)
+{
+	struct nvshm_server_ntfy *ntfy;
+	list_for_each_entry(ntfy, &sc->ntfy, head) {
+		if (ntfy->index == index)
+			return ntfy;
+	}
+	return NULL;
+}
+
+static int
+nvshm_server_ntfy_new(struct nvshm_server_chan *sc, void *argv, u32 argc)
+{
+	struct nvif_ioctl_v0 *ioctl = argv;
+	void *data = ioctl->data;
+	u32 size = argc - sizeof(*ioctl);
+	union {
+		struct nvif_ioctl_ntfy_new_v0 v0;
+	} *args = data;
+	union {
+		struct nvif_notify_req_v0 v0;
+	} *req;
+	struct nvshm_server_ntfy *ntfy;
+	int ret;
+
+	if (!nvif_unpack(args->v0, 0, 0, true))
+		return ret;
+	req = data;
+
+	if (!(ntfy = kmalloc(sizeof(*ntfy), GFP_KERNEL)))
+		return -ENOMEM;
+	ntfy->chan = sc;
+
+	if (nvif_unpack(req->v0, 0, 0, true)) {
+		ntfy->reply = sizeof(struct nvif_notify_rep_v0) + req->v0.reply;
+		ntfy->route = req->v0.route;
+		ntfy->token = req->v0.token;
+		req->v0.route = NVIF_NOTIFY_V0_ROUTE_NVIF;
+		req->v0.token = (unsigned long)(void *)ntfy;
+		ret = sc->drv->ioctl(sc->priv, sc->super, argv, argc, NULL);
+		req->v0.token = ntfy->token;
+		req->v0.route = ntfy->route;
+	}
+
+	/* the index is only known once nvkm has allocated it */
+	if (ret == 0) {
+		ntfy->index = args->v0.index;
+		list_add(&ntfy->head, &sc->ntfy);
+	} else
+		kfree(ntfy);
+	return ret;
+}
+
+static int
+nvshm_server_ntfy_del(struct nvshm_server_chan *sc, void *argv, u32 argc)
+{
+	struct nvif_ioctl_v0 *ioctl = argv;
+	void *data = ioctl->data;
+	u32 size = argc - sizeof(*ioctl);
+	union {
+		struct nvif_ioctl_ntfy_del_v0 v0;
+	} *args = data;
+	struct nvshm_server_ntfy *ntfy;
+	int ret;
+
+	if (nvif_unpack(args->v0, 0, 0, true)) {
+		if (!(ntfy = nvshm_server_ntfy_find(sc, args->v0.index)))
+			return -ENOENT;
+	} else
+		return ret;
+
+	ret = sc->drv->ioctl(sc->priv, sc->super, argv, argc, NULL);
+	if (ret == 0) {
+		list_del(&ntfy->head);
+		kfree(ntfy);
+	}
+	return ret;
+}
+
+/* the request is copied out of the channel before it's looked at, so the
+ * client can't change it underneath nvkm once validated, and the reply is
+ * copied back afterwards
+ */
+static int
+nvshm_server_ioctl(struct nvshm_server_chan *sc)
+{
+	struct nvshm_chan *chan = sc->chan;
+	struct nvif_ioctl_v0 *ioctl = (void *)sc->data;
+	u32 size = READ_ONCE(chan->size);
+	int ret;
+
+	if (size > sizeof(sc->data) || size < sizeof(*ioctl))
+		return -EINVAL;
+	memcpy(sc->data, chan->data, size);
+
+	if (ioctl->version != 0)
+		return -EINVAL;
+
+	switch (ioctl->type) {
+	case NVIF_IOCTL_V0_NTFY_NEW:
+		ret = nvshm_server_ntfy_new(sc, sc->data, size);
+		break;
+	case NVIF_IOCTL_V0_NTFY_DEL:
+		ret = nvshm_server_ntfy_del(sc, sc->data, size);
+		break;
+	default:
+		ret = sc->drv->ioctl(sc->priv, sc->super, sc->data, size,
+				     NULL);
+		break;
+	}
+
+	memcpy(chan->data, sc->data, size);
+	return ret;
+}
+
+/* checks the client's channel can be mapped, and can't later be truncated
+ * to fault the server when it touches the mapping
+ */
+static bool
+nvshm_server_memfd(int memfd)
+{
+	const int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+	struct stat st;
+
+	if (fstat(memfd, &st) || st.st_size != sizeof(struct nvshm_chan))
+		return false;
+	return (fcntl(memfd, F_GET_SEALS) & seals) == seals;
+}
+
+/* receives the client's hello and channel, and creates its nvkm client */
+static int
+nvshm_server_hello(struct nvshm_server_chan *sc)
+{
+	struct nvshm_hello hello;
+	char cmsg[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &hello, sizeof(hello) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg,
+		.msg_controllen = sizeof(cmsg),
+	};
+	struct cmsghdr *cm;
+	int memfd, ret;
+
+	/* as nvshm_trusted() only admits our own user, or root, there's no
+	 * one to withhold supervisor access from
+	 */
+	if (!nvshm_trusted(sc->fd))
+		return -EACCES;
+	sc->super = true;
+
+	if (recvmsg(sc->fd, &msg, MSG_WAITALL) != sizeof(hello) ||
+	    !(cm = CMSG_FIRSTHDR(&msg)) || cm->cmsg_type != SCM_RIGHTS)
+		return -EINVAL;
+	memcpy(&memfd, CMSG_DATA(cm), sizeof(int));
+	hello.name[sizeof(hello.name) - 1] = '\0';
+	hello.cfg[sizeof(hello.cfg) - 1] = '\0';
+	hello.dbg[sizeof(hello.dbg) - 1] = '\0';
+
+	if (!nvshm_server_memfd(memfd)) {
+		close(memfd);
+		return -EINVAL;
+	}
+
+	sc->chan = mmap(NULL, sizeof(*sc->chan), PROT_READ | PROT_WRITE,
+			MAP_SHARED, memfd, 0);
+	close(memfd);
+	if (sc->chan == MAP_FAILED) {
+		sc->chan = NULL;
+		return -ENOMEM;
+	}
+
+	ret = sc->drv->init(hello.name, hello.device, hello.cfg, hello.dbg,
+			    &sc->priv);
+	if (ret) {
+		if (sc->priv)
+			sc->drv->fini(sc->priv);
+		sc->priv = NULL;
+		return ret;
+	}
+
+	((struct nvkm_client *)sc->priv)->ntfy = nvshm_server_notify;
+	return 0;
+}
+
+/* each channel is set up and served from its own thread, so a client that
+ * connects but never says hello can't hold up anyone else
+ */
+static void *
+nvshm_server_thread(void *arg)
+{
+	struct nvshm_server_chan *sc = arg;
+	struct nvshm_chan *chan;
+	struct nvshm_server_ntfy *ntfy, *temp;
+	int ret;
+	u32 seq;
+
+	ret = nvshm_server_hello(sc);
+	send(sc->fd, &ret, sizeof(ret), MSG_NOSIGNAL);
+	if (ret)
+		goto done;
+
+	chan = sc->chan;
+	seq = chan->req;
+	while (nvshm_wait(&chan->req, seq, sc->fd) == 0) {
+		seq = __atomic_load_n(&chan->req, __ATOMIC_ACQUIRE);
+		chan->ret = nvshm_server_ioctl(sc);
+		__atomic_add_fetch(&chan->rep, 1, __ATOMIC_RELEASE);
+		nvshm_wake(&chan->rep);
+	}
+
+	sc->drv->fini(sc->priv);
+	list_for_each_entry_safe(ntfy, temp, &sc->ntfy, head) {
+		list_del(&ntfy->head);
+		kfree(ntfy);
+	}
+done:
+	if (sc->chan)
+		munmap(sc->chan, sizeof(*sc->chan));
+	close(sc->fd);
+	free(sc);
+	return NULL;
+}
+
+static void
+nvshm_server_accept(const struct nvif_driver *drv, int fd)
+{
+	struct nvshm_server_chan *sc;
+	pthread_t thread;
+
+	if (!(sc = calloc(1, sizeof(*sc)))) {
+		close(fd);
+		return;
+	}
+	sc->drv = drv;
+	sc->fd = fd;
+	spin_lock_init(&sc->lock);
+	INIT_LIST_HEAD(&sc->ntfy);
+
+	if (pthread_create(&thread, NULL, nvshm_server_thread, sc)) {
+		close(fd);
+		free(sc);
+		return;
+	}
+	pthread_detach(thread);
+}
+
+/* serves clients using one of the in-process drivers, which also keeps
+ * a client of its own open so the device stays initialised between them
+ */
+int
+nvshm_server(const char *drv, const char *cfg, const char *dbg)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const struct nvif_driver *driver;
+	void *priv = NULL;
+	int fd, ret;
+
+	if (!strcmp(drv, nvif_driver_lib.name))
+		driver = &nvif_driver_lib;
+	else
+	if (!strcmp(drv, nvif_driver_null.name))
+		driver = &nvif_driver_null;
+	else
+		return -EINVAL;
+
+	if ((ret = driver->init("server", ~0ULL, cfg, dbg, &priv)))
+		goto done;
+
+	nvshm_path(&addr);
+	unlink(addr.sun_path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+	    bind(fd, (void *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0) {
+		ret = -errno;
+		goto done;
+	}
+
+	for (;;) {
+		int cfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+		if (cfd < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+		nvshm_server_accept(driver, cfd);
+	}
+
+	close(fd);
+	unlink(addr.sun_path);
+done:
+	if (priv)
+		driver->fini(priv);
+	return ret;
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+/* kmem_cache implementation, objects are carved out of large chunks and
+ * handed out through per-thread magazines (small stacks of free objects),
+ * so the common alloc/free path touches only thread-local state.  full
+ * and empty magazines are exchanged with a per-cache depot under a lock.
+ *
+ * a thread's magazines are returned to the depot when it exits.  as that
+ * can race with the cache being destroyed, the exit path only touches its
+ * per-thread state once it's found it still registered with a live cache.
+ */
+#define NVOS_MAGAZINE_SIZE 32
+#define NVOS_CHUNK_SIZE    (64 * 1024)
+
+struct nvos_magazine {
+	struct nvos_magazine *next;
+	int rounds;
+	void *obj[NVOS_MAGAZINE_SIZE];
+};
+
+struct nvos_slab_thread {
+	struct kmem_cache *cache;
+	struct list_head head;
+	struct nvos_magazine *loaded;
+	struct nvos_magazine *previous;
+};
+
+struct nvos_slab_chunk {
+	struct nvos_slab_chunk *next;
+};
+
+struct kmem_cache {
+	struct list_head head;
+	const char *name;
+	size_t size;
+	size_t align;
+	void (*ctor)(void *);
+	pthread_key_t key;
+
+	struct mutex mutex;
+	struct nvos_magazine *full;
+	struct nvos_magazine *empty;
+	struct nvos_slab_chunk *chunks;
+	struct list_head threads;
+};
+
+static DEFINE_MUTEX(nvos_slab_mutex);
+static LIST_HEAD(nvos_slab_caches);
+
+static struct nvos_magazine *
+nvos_magazine_get(struct nvos_magazine **plist)
+{
+	struct nvos_magazine *mag = *plist;
+	if (mag)
+		*plist = mag->next;
+	return mag;
+}
+
+static void
+nvos_magazine_put(struct nvos_magazine **plist, struct nvos_magazine *mag)
+{
+	mag->next = *plist;
+	*plist = mag;
+}
+
+static void
+nvos_slab_thread_fini(void *data)
+{
+	struct nvos_slab_thread *thread;
+	struct kmem_cache *cache;
+
+	mutex_lock(&nvos_slab_mutex);
+	list_for_each_entry(cache, &nvos_slab_caches, head) {
+		mutex_lock(&cache->mutex);
+		list_for_each_entry(thread, &cache->threads, head) {
+			if (thread == data)
+				goto found;
+		}
+		mutex_unlock(&cache->mutex);
+	}
+	mutex_unlock(&nvos_slab_mutex);
+	return;
+
+found:
+	nvos_magazine_put(thread->loaded->rounds ? &cache->full :
+			  &cache->empty, thread->loaded);
+	nvos_magazine_put(thread->previous->rounds ? &cache->full :
+			  &cache->empty, thread->previous);
+	list_del(&thread->head);
+	mutex_unlock(&cache->mutex);
+	mutex_unlock(&nvos_slab_mutex);
+	free(thread);
+}
+
+static struct nvos_slab_thread *
+nvos_slab_thread(struct kmem_cache *cache)
+{
+	struct nvos_slab_thread *thread = pthread_getspecific(cache->key);
+	if (likely(thread))
+		return thread;
+
+	if (!(thread = calloc(1, sizeof(*thread))))
+		return NULL;
+	thread->cache = cache;
+
+	if (!(thread->loaded = calloc(1, sizeof(*thread->loaded))) ||
+	    !(thread->previous = calloc(1, sizeof(*thread->previous)))) {
+		free(thread->loaded);
+		free(thread);
+		return NULL;
+	}
+
+	mutex_lock(&cache->mutex);
+	list_add(&thread->head, &cache->threads);
+	mutex_unlock(&cache->mutex);
+
+	pthread_setspecific(cache->key, thread);
+	return thread;
+}
+
+/* refill an empty magazine, either with a full one from the depot or
+ * with objects from a freshly allocated chunk
+ */
+static bool
+nvos_slab_refill(struct kmem_cache *cache, struct nvos_slab_thread *thread)
+{
+	struct nvos_magazine *mag = thread->loaded;
+	struct nvos_slab_chunk *chunk;
+	size_t offset;
+	u8 *data;
+
+	mutex_lock(&cache->mutex);
+	if (cache->full) {
+		nvos_magazine_put(&cache->empty, mag);
+		thread->loaded = nvos_magazine_get(&cache->full);
+		mutex_unlock(&cache->mutex);
+		return true;
+	}
+	mutex_unlock(&cache->mutex);
+
+	if (posix_memalign((void **)&chunk, cache->align, NVOS_CHUNK_SIZE))
+		return false;
+
+	data = (u8 *)chunk + roundup(sizeof(*chunk), cache->align);
+	offset = data - (u8 *)chunk;
+	while (offset + cache->size <= NVOS_CHUNK_SIZE) {
+		if (mag->rounds == NVOS_MAGAZINE_SIZE) {
+			/* stash any overflow in the depot for later */
+			struct nvos_magazine *full = mag;
+			mutex_lock(&cache->mutex);
+			if (!(mag = nvos_magazine_get(&cache->empty)))
+				mag = calloc(1, sizeof(*mag));
+			if (mag)
+				nvos_magazine_put(&cache->full, full);
+			mutex_unlock(&cache->mutex);
+			if (!mag) {
+				mag = full;
+				break;
+			}
+		}
+
+		if (cache->ctor)
+			cache->ctor((u8 *)chunk + offset);
+		mag->obj[mag->rounds++] = (u8 *)chunk + offset;
+		offset += cache->size;
+	}
+	thread->loaded = mag;
+
+	mutex_lock(&cache->mutex);
+	chunk->next = cache->chunks;
+	cache->chunks = chunk;
+	mutex_unlock(&cache->mutex);
+	return true;
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *cache, gfp_t gfp)
+{
+	struct nvos_slab_thread *thread = nvos_slab_thread(cache);
+	struct nvos_magazine *mag;
+	void *obj;
+
+	if (unlikely(!thread))
+		return NULL;
+
+	if (unlikely(!thread->loaded->rounds)) {
+		if (thread->previous->rounds) {
+			mag = thread->loaded;
+			thread->loaded = thread->previous;
+			thread->previous = mag;
+		} else
+		if (!nvos_slab_refill(cache, thread))
+			return NULL;
+	}
+
+	mag = thread->loaded;
+	obj = mag->obj[--mag->rounds];
+	if (gfp & __GFP_ZERO)
+		memset(obj, 0x00, cache->size);
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct nvos_slab_thread *thread;
+	struct nvos_magazine *mag;
+
+	if (!obj)
+		return;
+
+	thread = nvos_slab_thread(cache);
+	BUG_ON(!thread);
+
+	if (unlikely(thread->loaded->rounds == NVOS_MAGAZINE_SIZE)) {
+		if (!thread->previous->rounds) {
+			mag = thread->loaded;
+			thread->loaded = thread->previous;
+			thread->previous = mag;
+		} else {
+			mutex_lock(&cache->mutex);
+			if ((mag = nvos_magazine_get(&cache->empty)) ||
+			    (mag = calloc(1, sizeof(*mag)))) {
+				nvos_magazine_put(&cache->full, thread->loaded);
+				thread->loaded = mag;
+			}
+			mutex_unlock(&cache->mutex);
+			BUG_ON(!mag);
+		}
+	}
+
+	mag = thread->loaded;
+	mag->obj[mag->rounds++] = obj;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *cache)
+{
+	struct nvos_slab_thread *thread, *temp;
+	struct nvos_slab_chunk *chunk;
+	struct nvos_magazine *mag;
+
+	if (!cache)
+		return;
+
+	mutex_lock(&nvos_slab_mutex);
+	list_del(&cache->head);
+	pthread_key_delete(cache->key);
+	mutex_unlock(&nvos_slab_mutex);
+
+	list_for_each_entry_safe(thread, temp, &cache->threads, head) {
+		free(thread->loaded);
+		free(thread->previous);
+		free(thread);
+	}
+
+	while ((mag = nvos_magazine_get(&cache->full)))
+		free(mag);
+	while ((mag = nvos_magazine_get(&cache->empty)))
+		free(mag);
+
+	while ((chunk = cache->chunks)) {
+		cache->chunks = chunk->next;
+		free(chunk);
+	}
+
+	pthread_mutex_destroy(&cache->mutex.mutex);
+	free(cache);
+}
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache *cache;
+
+	if (!(cache = calloc(1, sizeof(*cache))))
+		return NULL;
+
+	if (flags & SLAB_HWCACHE_ALIGN)
+		align = max_t(size_t, align, 64);
+	align = max_t(size_t, align, sizeof(void *));
+	BUG_ON(!is_power_of_2(align));
+
+	cache->name = name;
+	cache->align = align;
+	cache->size = roundup(size, align);
+	cache->ctor = ctor;
+	BUG_ON(cache->size > NVOS_CHUNK_SIZE / 8);
+
+	if (pthread_key_create(&cache->key, nvos_slab_thread_fini)) {
+		free(cache);
+		return NULL;
+	}
+
+	mutex_init(&cache->mutex);
+	INIT_LIST_HEAD(&cache->threads);
+
+	mutex_lock(&nvos_slab_mutex);
+	list_add(&cache->head, &nvos_slab_caches);
+	mutex_unlock(&nvos_slab_mutex);
+	return cache;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+#if !defined(CONFIG_NVOS_SPINLOCK_MUTEX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* number of times to poll the lock before sleeping on it, spinning is
+ * pointless on a uniprocessor where the holder can't run meanwhile
+ */
+#define NVOS_SPIN_MAX 1000
+static int nvos_spin_max = -1;
+
+void
+nvos_spin_lock_slow(spinlock_t *lock)
+{
+	u32 value;
+	int i;
+
+	if (unlikely(nvos_spin_max < 0))
+		nvos_spin_max = sysconf(_SC_NPROCESSORS_ONLN) > 1 ?
+				NVOS_SPIN_MAX : 0;
+
+	for (i = 0; i < nvos_spin_max; i++) {
+		value = 0;
+		if (__atomic_load_n(&lock->value, __ATOMIC_RELAXED) == 0 &&
+		    __atomic_compare_exchange_n(&lock->value, &value, 1, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return;
+		cpu_relax();
+	}
+
+	/* mark the lock as having sleepers, so the holder knows to wake
+	 * one of us when it's released
+	 */
+	while (__atomic_exchange_n(&lock->value, 2, __ATOMIC_ACQUIRE) != 0) {
+		syscall(SYS_futex, &lock->value, FUTEX_WAIT_PRIVATE, 2,
+			NULL, NULL, 0);
+	}
+}
+
+void
+nvos_spin_unlock_wake(spinlock_t *lock)
+{
+	syscall(SYS_futex, &lock->value, FUTEX_WAKE_PRIVATE, 1,
+		NULL, NULL, 0);
+}
+#endif
+
+#if defined(CONFIG_NVOS_LOCKDEP)
+/******************************************************************************
+ * lockdep-lite: catch recursion, unlocks by the wrong thread, and asserts
+ * that the current thread holds the lock
+ *****************************************************************************/
+bool
+nvos_lockdep_held(spinlock_t *lock)
+{
+	return READ_ONCE(lock->held) &&
+	       pthread_equal(lock->holder, pthread_self());
+}
+
+void
+nvos_lockdep_acquire(spinlock_t *lock)
+{
+	if (nvos_lockdep_held(lock)) {
+		printk("lockdep: recursive locking of %p\n", lock);
+		BUG();
+	}
+}
+
+void
+nvos_lockdep_acquired(spinlock_t *lock)
+{
+	lock->holder = pthread_self();
+	WRITE_ONCE(lock->held, true);
+}
+
+void
+nvos_lockdep_release(spinlock_t *lock)
+{
+	if (!nvos_lockdep_held(lock)) {
+		printk("lockdep: releasing %p, not held by this thread\n", lock);
+		BUG();
+	}
+	WRITE_ONCE(lock->held, false);
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2015 Red Hat Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "priv.h"
+
+#include <errno.h>
+
+/* sleeping costs a syscall and at least the thread's timer slack (50us by
+ * default), shorter delays are cheaper and more accurate as a busy-wait
+ */
+#define NVOS_DELAY_SPIN_MAX (50 * NSEC_PER_USEC)
+
+void
+nvos_nsleep(u64 nsecs)
+{
+	s64 end = ktime_get() + nsecs;
+	struct timespec ts = {
+		.tv_sec = end / NSEC_PER_SEC,
+		.tv_nsec = end % NSEC_PER_SEC,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR) {
+	}
+}
+
+void
+nvos_ndelay(u64 nsecs)
+{
+	s64 end;
+
+	if (nsecs > NVOS_DELAY_SPIN_MAX) {
+		nvos_nsleep(nsecs);
+		return;
+	}
+
+	end = ktime_get() + nsecs;
+	while (ktime_get() < end)
+		cpu_relax();
+}
@@ -23,85 +23,178 @@
  */
 #include "priv.h"
 
-struct nvos_work {
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
+#include <semaphore.h>
+
+/* work items from every schedule_work() caller are pushed onto a single
+ * lock-free stack, and serviced by a fixed pool of worker threads which
+ * take turns (under pool.mutex) draining it into a FIFO
+ */
+#define NVOS_WORK_PENDING 0
+#define NVOS_WORKERS 4
+
+struct nvos_worker {
 	pthread_t thread;
-	bool done;
+	struct work_struct *current;
+	bool requeue;
+};
 
-	void (*func)(void *);
-	void *priv;
+static struct {
+	pthread_once_t once;
+	pthread_mutex_t mutex;
+	pthread_cond_t done;
+	sem_t sem;
+
+	struct work_struct *head;
+	struct work_struct *fifo;
+
+	struct nvos_worker worker[NVOS_WORKERS];
+	int workers;
+} pool = {
+	.once = PTHREAD_ONCE_INIT,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
 };
 
+static __thread struct nvos_worker *nvos_worker_self;
+
+static struct nvos_worker *
+nvos_work_running(struct work_struct *work)
+{
+	int i;
+	for (i = 0; i < pool.workers; i++) {
+		if (pool.worker[i].current == work)
+			return &pool.worker[i];
+	}
+	return NULL;
+}
+
+static struct work_struct *
+nvos_work_next(void)
+{
+	struct work_struct *work, *next;
+
+	if (!pool.fifo) {
+		/* reverse the submission stack into execution order */
+		work = __atomic_exchange_n(&pool.head, NULL, __ATOMIC_ACQUIRE);
+		while (work) {
+			next = work->next;
+			work->next = pool.fifo;
+			pool.fifo = work;
+			work = next;
+		}
+	}
+
+	if ((work = pool.fifo))
+		pool.fifo = work->next;
+	return work;
+}
+
 static void *
 nvos_work(void *data)
 {
-	struct nvos_work *work = data;
+	struct nvos_worker *self = nvos_worker_self = data;
+	struct nvos_worker *busy;
+	struct work_struct *work;
 
-	do {
-		pthread_mutex_lock(&work->mutex);
-		while (!work->priv && !work->done)
-			pthread_cond_wait(&work->cond, &work->mutex);
-		if (work->priv) {
-			work->func(work->priv);
-			work->priv = NULL;
+	while (1) {
+		while (sem_wait(&pool.sem))
+			;
+
+		pthread_mutex_lock(&pool.mutex);
+		work = nvos_work_next();
+		if (WARN_ON(!work)) {
+			pthread_mutex_unlock(&pool.mutex);
+			continue;
+		}
+
+		/* a work item never runs on two workers at once, if it's
+		 * been requeued while executing, hand it back to the worker
+		 * that's running it
+		 */
+		if ((busy = nvos_work_running(work))) {
+			busy->requeue = true;
+			pthread_mutex_unlock(&pool.mutex);
+			continue;
 		}
-		pthread_mutex_unlock(&work->mutex);
-	} while (!work->done);
+
+		self->current = work;
+		test_and_clear_bit(NVOS_WORK_PENDING, &work->flags);
+		pthread_mutex_unlock(&pool.mutex);
+
+		work->func(work);
+
+		/* the work item may have been freed by its handler, don't
+		 * touch it again unless it was requeued in the meantime
+		 */
+		pthread_mutex_lock(&pool.mutex);
+		if (self->requeue) {
+			work->next = pool.fifo;
+			pool.fifo = work;
+			self->requeue = false;
+			sem_post(&pool.sem);
+		}
+		self->current = NULL;
+		pthread_cond_broadcast(&pool.done);
+		pthread_mutex_unlock(&pool.mutex);
+	}
 
 	return NULL;
 }
 
-void
-nvos_work_fini(struct nvos_work **pwork)
+static void
+nvos_work_init(void)
 {
-	struct nvos_work *work = *pwork;
-	if (work) {
-		pthread_mutex_lock(&work->mutex);
-		work->done = true;
-		pthread_cond_signal(&work->cond);
-		pthread_mutex_unlock(&work->mutex);
-
-		pthread_join(work->thread, NULL);
-		pthread_cond_destroy(&work->cond);
-		pthread_mutex_destroy(&work->mutex);
-		free(*pwork);
-		*pwork = NULL;
+	int i;
+
+	if (sem_init(&pool.sem, 0, 0))
+		BUG();
+
+	for (i = 0; i < NVOS_WORKERS; i++) {
+		if (pthread_create(&pool.worker[i].thread, NULL, nvos_work,
+				   &pool.worker[i]))
+			break;
+		pool.workers++;
 	}
+
+	BUG_ON(!pool.workers);
 }
 
 bool
-nvos_work_init(void (*func)(void *), void *priv, struct nvos_work **pwork)
+nvos_work_queue(struct work_struct *work)
 {
-	struct nvos_work *work = *pwork;
-
-	if (unlikely(work == NULL)) {
-		if (!(work = calloc(1, sizeof(*work))))
-			return false;
-		work->func = func;
-		work->priv = NULL;
-		work->done = false;
-
-		if (pthread_mutex_init(&work->mutex, NULL))
-			goto fail_mutex;
-		if (pthread_cond_init(&work->cond, NULL))
-			goto fail_cond;
-		if (pthread_create(&work->thread, NULL, nvos_work, work))
-			goto fail_thread;
-		*pwork = work;
-	}
+	struct work_struct *head;
+
+	pthread_once(&pool.once, nvos_work_init);
+
+	if (test_and_set_bit(NVOS_WORK_PENDING, &work->flags))
+		return false;
 
-	pthread_mutex_lock(&work->mutex);
-	work->priv = priv;
-	pthread_cond_signal(&work->cond);
-	pthread_mutex_unlock(&work->mutex);
+	head = __atomic_load_n(&pool.head, __ATOMIC_RELAXED);
+	do {
+		work->next = head;
+	} while (!__atomic_compare_exchange_n(&pool.head, &head, work, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	sem_post(&pool.sem);
 	return true;
+}
 
-fail_thread:
-	pthread_cond_destroy(&work->cond);
-fail_cond:
-	pthread_mutex_destroy(&work->mutex);
-fail_mutex:
-	free(work);
-	return false;
+bool
+nvos_work_flush(struct work_struct *work)
+{
+	bool ret = false;
+
+	/* flushing a work item from its own handler would never complete */
+	if (nvos_worker_self && nvos_worker_self->current == work)
+		return false;
+
+	pthread_mutex_lock(&pool.mutex);
+	while (test_bit(NVOS_WORK_PENDING, &work->flags) ||
+	       nvos_work_running(work)) {
+		pthread_cond_wait(&pool.done, &pool.mutex);
+		ret = true;
+	}
+	pthread_mutex_unlock(&pool.mutex);
+	return ret;
 }